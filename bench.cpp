@@ -0,0 +1,882 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <new>
+#include <regex>
+#include <string>
+
+#include <malloc.h>
+
+#include "read.hpp"
+#include "eval.hpp"
+#include "vm.hpp"
+#include "print.hpp"
+
+// count every heap allocation, and the bytes still allocated,
+// so benchmarks can report them
+std::size_t allocations = 0;
+std::size_t live_bytes = 0;
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if (void* p = std::malloc(size)) {
+        live_bytes += malloc_usable_size(p);
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    live_bytes -= malloc_usable_size(p);
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    live_bytes -= malloc_usable_size(p);
+    std::free(p);
+}
+
+// std::pmr::new_delete_resource allocates through the aligned versions
+void* operator new(std::size_t size, std::align_val_t align) {
+    ++allocations;
+    if (void* p = std::aligned_alloc(static_cast<std::size_t>(align), (size + static_cast<std::size_t>(align) - 1) & ~(static_cast<std::size_t>(align) - 1))) {
+        live_bytes += malloc_usable_size(p);
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    live_bytes -= malloc_usable_size(p);
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    live_bytes -= malloc_usable_size(p);
+    std::free(p);
+}
+
+// the regex tokenizer that read.hpp used before the hand-written lexer,
+// kept here so the two can be compared
+namespace regex_reader {
+
+using namespace zachlisp::token;
+
+const std::regex REGEX(
+    "([\\s,]+)|"                   // type::WHITESPACE
+    "(~@|#\\{)|"                   // type::SPECIAL_CHARS
+    "([\\[\\]{}()\'`~^@])|"        // type::SPECIAL_CHAR
+    "(\"(?:\\\\.|[^\\\\\"])*\"?)|" // type::STRING
+    "(;.*)|"                       // type::COMMENT
+    "(\\d+\\.?\\d*)|"              // type::NUMBER
+    "([^\\s\\[\\]{}(\'\"`,;)]+)"   // type::SYMBOL
+);
+
+std::list<Token> tokenize(std::string input) {
+    std::sregex_iterator begin(input.begin(), input.end(), REGEX);
+    std::sregex_iterator end;
+
+    std::list<Token> tokens;
+
+    int line = 1;
+
+    for (auto it = begin; it != end; ++it) {
+        std::smatch match = *it;
+        for (std::size_t i = 1; i < match.size(); ++i) {
+            if (!match[i].str().empty()) {
+                std::string value_str = match.str();
+                type::Type type = static_cast<type::Type>(i-1);
+                tokens.push_back(Token{parse(value_str, type), type, line, static_cast<int>(match.position()) + 1});
+                line += std::count(value_str.begin(), value_str.end(), '\n');
+                break;
+            }
+        }
+    }
+
+    return tokens;
+}
+
+}
+
+// a document of many small nested maps, like our config blobs
+std::string make_document(std::size_t size) {
+    std::string doc;
+    for (int i = 0; doc.size() < size; ++i) {
+        doc += "{:id " + std::to_string(i) + ", :name \"item " + std::to_string(i) + "\" ; entry\n"
+               " :reference/description \"a longer description of the item\"\n"
+               " :tags #{foo bar} :pos [1.5 -2 " + std::to_string(i * 3) + "] :f '(+ x ~@ys)}\n";
+    }
+    return doc;
+}
+
+double seconds(std::function<void()> fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void report(const std::string & name, std::size_t bytes, double secs) {
+    std::cout << name << ": " << secs * 1000 << " ms";
+    if (bytes > 0) {
+        std::cout << ", " << (bytes / secs) / (1024 * 1024) << " MB/s";
+    }
+    std::cout << std::endl;
+}
+
+void bench_tokenize() {
+    std::string doc = make_document(4 * 1024 * 1024);
+    std::size_t count = 0;
+
+    report("tokenize (regex)", doc.size(), seconds([&] {
+        count = regex_reader::tokenize(doc).size();
+    }));
+    report("tokenize (lexer)", doc.size(), seconds([&] {
+        if (zachlisp::token::tokenize(doc).size() != count) {
+            std::cout << "token count mismatch!" << std::endl;
+        }
+    }));
+}
+
+void bench_read_view() {
+    std::string doc = make_document(4 * 1024 * 1024);
+    std::size_t tokens = zachlisp::token::tokenize(doc).size();
+
+    for (auto view : {false, true}) {
+        std::size_t before = allocations;
+        double secs = seconds([&] {
+            auto forms = view ? zachlisp::read_view(doc) : zachlisp::read(doc);
+        });
+        report(view ? "read_view" : "read", doc.size(), secs);
+        std::cout << "  " << static_cast<double>(allocations - before) / tokens << " allocations per token" << std::endl;
+    }
+}
+
+std::filesystem::path write_document(std::size_t size) {
+    auto path = std::filesystem::temp_directory_path() / "zachlisp-bench.edn";
+    std::ofstream(path) << make_document(size);
+    return path;
+}
+
+std::size_t read_whole_file(const std::filesystem::path & path) {
+    std::size_t count = 0;
+    report("read (whole file)", std::filesystem::file_size(path), seconds([&] {
+        std::ifstream in(path);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        count = zachlisp::read(ss.str()).size();
+    }));
+    return count;
+}
+
+void bench_reader() {
+    auto path = write_document(32 * 1024 * 1024);
+    std::size_t count = read_whole_file(path);
+    report("Reader", std::filesystem::file_size(path), seconds([&] {
+        std::ifstream in(path);
+        zachlisp::Reader reader(in);
+        std::size_t n = 0;
+        while (reader.next()) {
+            ++n;
+        }
+        if (n != count) {
+            std::cout << "form count mismatch!" << std::endl;
+        }
+    }));
+
+    std::filesystem::remove(path);
+}
+
+void bench_read_file() {
+    auto path = write_document(32 * 1024 * 1024);
+    std::size_t count = read_whole_file(path);
+
+    report("read_file", std::filesystem::file_size(path), seconds([&] {
+        if (zachlisp::read_file(path).forms.size() != count) {
+            std::cout << "form count mismatch!" << std::endl;
+        }
+    }));
+
+    std::filesystem::remove(path);
+}
+
+void bench_read_parallel() {
+    std::string doc = make_document(16 * 1024 * 1024);
+    std::list<zachlisp::form::Form> serial, parallel;
+
+    report("read", doc.size(), seconds([&] {
+        serial = zachlisp::read(doc);
+    }));
+    // how long finding where the pieces start takes, which is part of read_parallel
+    std::size_t pieces = 0;
+    report("split_forms (" + std::to_string(std::thread::hardware_concurrency()) + " threads)", doc.size(), seconds([&] {
+        pieces = zachlisp::split_forms(doc, std::thread::hardware_concurrency() * 4).size();
+    }));
+    report("split_forms_serially", doc.size(), seconds([&] {
+        zachlisp::split_forms_serially(doc, pieces);
+    }));
+    report("read_parallel (" + std::to_string(std::thread::hardware_concurrency()) + " threads)", doc.size(), seconds([&] {
+        parallel = zachlisp::read_parallel(doc);
+    }));
+
+    if (zachlisp::print(serial) != zachlisp::print(parallel)) {
+        std::cout << "read_parallel returned different forms!" << std::endl;
+    }
+}
+
+void bench_scan() {
+    namespace simd = zachlisp::token::simd;
+    std::string doc = make_document(32 * 1024 * 1024);
+    const std::vector<std::pair<std::string, simd::Skip>> impls = {
+        {"scalar", simd::skip_scalar},
+#ifdef ZACHLISP_SIMD
+        {"sse2", simd::skip_sse2},
+        {"avx2", simd::skip_avx2},
+#endif
+    };
+
+    auto selected = simd::skip;
+    for (auto & [name, impl] : impls) {
+        if (name == "avx2" && !__builtin_cpu_supports("avx2")) {
+            continue;
+        }
+        simd::skip = impl;
+        std::size_t count = 0;
+        report("scan (" + name + ")", doc.size(), seconds([&] {
+            zachlisp::token::type::Type type;
+            for (std::size_t pos = 0; pos < doc.size(); pos = zachlisp::token::scan(doc, pos, type)) {
+                ++count;
+            }
+        }));
+        report("tokenize (" + name + ")", doc.size(), seconds([&] {
+            zachlisp::token::tokenize(doc, true);
+        }));
+    }
+    simd::skip = selected;
+}
+
+void bench_numbers() {
+    std::string doc = "[";
+    for (int i = 0; doc.size() < 16 * 1024 * 1024; ++i) {
+        doc += std::to_string(i * 0.37) + " " + std::to_string(-i) + " " + std::to_string(i) + ".5e-3 ";
+    }
+    doc += "]";
+
+    // how read.hpp parsed numbers before from_chars
+    auto parse_stod = [](std::string_view value) -> zachlisp::token::value::Value {
+        if (value.find('.') == std::string::npos) {
+            return std::stol(std::string(value));
+        } else {
+            return std::stod(std::string(value));
+        }
+    };
+    for (bool old : {true, false}) {
+        std::size_t before = allocations;
+        report(old ? "numbers (stol/stod)" : "numbers (from_chars)", doc.size(), seconds([&] {
+            zachlisp::token::type::Type type;
+            for (std::size_t pos = 0, end; pos < doc.size(); pos = end) {
+                end = zachlisp::token::scan(doc, pos, type);
+                if (type == zachlisp::token::type::NUMBER) {
+                    auto text = std::string_view(doc).substr(pos, end - pos);
+                    old ? parse_stod(text) : zachlisp::token::parse_number(text, true);
+                }
+            }
+        }));
+        std::cout << "  " << allocations - before << " allocations" << std::endl;
+    }
+    report("read", doc.size(), seconds([&] {
+        zachlisp::read(doc);
+    }));
+}
+
+void bench_symbols() {
+    // keyword-heavy maps with names too long for the small string optimization
+    std::string doc;
+    for (int i = 0; doc.size() < 16 * 1024 * 1024; ++i) {
+        doc += "{:customer/identifier " + std::to_string(i) + " :customer/display-name \"c\""
+               " :customer/account-status :account-status/active}\n";
+    }
+    std::size_t tokens = zachlisp::token::tokenize(doc).size();
+
+    std::size_t before = allocations;
+    std::list<zachlisp::form::Form> forms;
+    report("read (interned symbols)", doc.size(), seconds([&] {
+        forms = zachlisp::read(doc);
+    }));
+    std::cout << "  " << static_cast<double>(allocations - before) / tokens << " allocations per token" << std::endl;
+
+    auto a = zachlisp::token::Token{zachlisp::token::value::intern(":customer/account-status"), zachlisp::token::type::SYMBOL, 0, 0};
+    auto b = zachlisp::token::Token{zachlisp::token::value::intern(":customer/account-status"), zachlisp::token::type::SYMBOL, 0, 0};
+    auto c = zachlisp::token::Token{std::string(":customer/account-status"), zachlisp::token::type::SYMBOL, 0, 0};
+    auto d = zachlisp::token::Token{std::string(":customer/account-status"), zachlisp::token::type::SYMBOL, 0, 0};
+    std::size_t equal = 0;
+    report("compare 10M interned symbols", 0, seconds([&] {
+        for (int i = 0; i < 10000000; ++i) {
+            equal += a == b;
+        }
+    }));
+    report("compare 10M string symbols", 0, seconds([&] {
+        for (int i = 0; i < 10000000; ++i) {
+            equal += c == d;
+        }
+    }));
+}
+
+void bench_arena() {
+    // a large nested document, one big map of vectors of maps
+    std::string doc = "{";
+    for (int i = 0; doc.size() < 16 * 1024 * 1024; ++i) {
+        doc += ":k" + std::to_string(i) + " [{:a (1 2 3) :b #{x y}} {:c [4 5 [6 7]]} (f (g (h)))]\n";
+    }
+    doc += "}";
+
+    for (bool arena : {false, true}) {
+        std::string name = arena ? "read (arena)" : "read";
+        std::size_t before = allocations;
+        double destroy_secs = 0;
+        double read_secs = seconds([&] {
+            std::pmr::monotonic_buffer_resource resource;
+            auto forms = arena ? zachlisp::read(doc, &resource, true) : zachlisp::read_view(doc);
+            std::cout << name << ": " << allocations - before << " allocations" << std::endl;
+            destroy_secs = seconds([&] {
+                forms.clear();
+                resource.release();
+            });
+        });
+        report("  read", doc.size(), read_secs - destroy_secs);
+        report("  free", 0, destroy_secs);
+    }
+}
+
+void bench_hash() {
+    // a map keyed by large nested maps, looked up over and over
+    std::string doc = "{";
+    for (int i = 0; i < 64; ++i) {
+        doc += "{:id " + std::to_string(i) + " :tags #{";
+        for (int j = 0; j < 256; ++j) {
+            doc += ":t" + std::to_string(j) + " ";
+        }
+        doc += "} :path [1 2 [3 4 {:x " + std::to_string(i) + "}]]} " + std::to_string(i) + "\n";
+    }
+    doc += "}";
+    auto form = zachlisp::form::FormWrapper(zachlisp::read_view(doc).front());
+    auto & map = zachlisp::form::get<zachlisp::form::FormWrapperMap>(form.form);
+
+    std::vector<zachlisp::form::FormWrapper> keys;
+    for (auto & item : map) {
+        keys.push_back(item.first);
+    }
+
+    const int rounds = 10000;
+    std::size_t found = 0;
+    double secs = seconds([&] {
+        for (int i = 0; i < rounds; ++i) {
+            for (auto & key : keys) {
+                found += map.count(key);
+            }
+        }
+    });
+    std::cout << "lookups: " << found << std::endl;
+    report("  lookup", 0, secs);
+}
+
+zachlisp::form::FormWrapper number(long n) {
+    return zachlisp::form::FormWrapper(zachlisp::token::Token{n, zachlisp::token::type::NUMBER, 0, 0});
+}
+
+void bench_map() {
+    using CopyOnWrite = std::unordered_map<zachlisp::form::FormWrapper, zachlisp::form::FormWrapper,
+        zachlisp::form::FormWrapperHash, zachlisp::form::FormWrapperEquality>;
+
+    // copying the whole table for every assoc is quadratic, so it gets fewer
+    const long copies = 20000;
+    double copy_secs = seconds([&] {
+        auto map = std::make_shared<const CopyOnWrite>();
+        for (long i = 0; i < copies; ++i) {
+            auto next = std::make_shared<CopyOnWrite>(*map);
+            next->emplace(number(i), number(i));
+            map = next;
+        }
+    });
+    std::cout << "copy on write: " << copies << " assocs" << std::endl;
+    report("  assoc", 0, copy_secs);
+
+    for (long n : {copies, 1000000L}) {
+        zachlisp::form::FormWrapperMap map;
+        double secs = seconds([&] {
+            for (long i = 0; i < n; ++i) {
+                map = map.assoc(number(i), number(i));
+            }
+        });
+        std::cout << "persistent: " << n << " assocs" << std::endl;
+        report("  assoc", 0, secs);
+
+        secs = seconds([&] {
+            for (long i = 0; i < n; ++i) {
+                map = map.dissoc(number(i));
+            }
+        });
+        report("  dissoc", 0, secs);
+    }
+
+    zachlisp::form::FormWrapperMap map;
+    double secs = seconds([&] {
+        auto transient = map.transient();
+        for (long i = 0; i < 1000000; ++i) {
+            transient.assoc(number(i), number(i));
+        }
+        map = transient.persistent();
+    });
+    std::cout << "transient: " << map.size() << " assocs" << std::endl;
+    report("  assoc", 0, secs);
+
+    std::size_t found = 0;
+    secs = seconds([&] {
+        for (long i = 0; i < 1000000; ++i) {
+            found += map.count(number(i));
+        }
+    });
+    std::cout << "lookups: " << found << std::endl;
+    report("  lookup", 0, secs);
+}
+
+void bench_vector() {
+    const long n = 10000000;
+
+    // copying the whole vector for every conj is quadratic, so it gets fewer
+    const long copies = 20000;
+    double copy_secs = seconds([&] {
+        auto vector = std::make_shared<const std::vector<zachlisp::form::FormWrapper>>();
+        for (long i = 0; i < copies; ++i) {
+            auto next = std::make_shared<std::vector<zachlisp::form::FormWrapper>>(*vector);
+            next->push_back(number(i));
+            vector = next;
+        }
+    });
+    std::cout << "copy on write: " << copies << " conjs" << std::endl;
+    report("  conj", 0, copy_secs);
+
+    zachlisp::form::Vector vector;
+    double secs = seconds([&] {
+        for (long i = 0; i < n; ++i) {
+            vector = vector.conj(number(i));
+        }
+    });
+    std::cout << "persistent: " << vector.size() << " conjs" << std::endl;
+    report("  conj", 0, secs);
+
+    secs = seconds([&] {
+        auto transient = zachlisp::form::Vector().transient();
+        for (long i = 0; i < n; ++i) {
+            transient.push_back(number(i));
+        }
+        vector = transient.persistent();
+    });
+    std::cout << "transient: " << vector.size() << " conjs" << std::endl;
+    report("  conj", 0, secs);
+
+    std::size_t total = 0;
+    secs = seconds([&] {
+        for (long i = 0; i < 1000000; ++i) {
+            total += vector.slice(i, n - i).size();
+        }
+    });
+    std::cout << "slices: " << total << " items" << std::endl;
+    report("  slice", 0, secs);
+
+    secs = seconds([&] {
+        total = vector.concat(vector.slice(0, 1000000)).size();
+    });
+    std::cout << "concat: " << total << " items" << std::endl;
+    report("  concat", 0, secs);
+}
+
+void bench_list() {
+    const long n = 10000000;
+    zachlisp::form::List list;
+    double secs = seconds([&] {
+        for (long i = 0; i < n; ++i) {
+            list = list.cons(number(i));
+        }
+    });
+    std::cout << "cons: " << list.size() << " items" << std::endl;
+    report("  cons", 0, secs);
+
+    std::size_t total = 0;
+    secs = seconds([&] {
+        for (auto rest = list; !rest.empty(); rest = rest.rest()) {
+            ++total;
+        }
+    });
+    std::cout << "rest: " << total << " items" << std::endl;
+    report("  rest", 0, secs);
+
+    // splitting a call into its function and arguments, as eval does
+    auto call = zachlisp::form::FormWrapper(zachlisp::read("(f 1 \"two\" [3] {:four 4} (five))").front());
+    auto & items = zachlisp::form::get<zachlisp::form::List>(call.form);
+    std::pmr::list<zachlisp::form::FormWrapper> copied(items.begin(), items.end());
+    const long calls = 1000000;
+    total = 0;
+    std::size_t before = allocations;
+    secs = seconds([&] {
+        for (long i = 0; i < calls; ++i) {
+            auto args = copied;
+            args.pop_front();
+            total += args.size();
+        }
+    });
+    std::cout << "copy and pop_front: " << allocations - before << " allocations" << std::endl;
+    report("  split", 0, secs);
+
+    before = allocations;
+    secs = seconds([&] {
+        for (long i = 0; i < calls; ++i) {
+            total += items.rest().size();
+        }
+    });
+    std::cout << "rest: " << allocations - before << " allocations" << std::endl;
+    report("  split", 0, secs);
+}
+
+std::size_t count_nodes(const zachlisp::form::Form & form) {
+    std::size_t nodes = 1;
+    switch (form.index()) {
+        case zachlisp::form::LIST:
+            for (auto & item : zachlisp::form::get<zachlisp::form::List>(form)) {
+                nodes += count_nodes(item.form);
+            }
+            break;
+        case zachlisp::form::VECTOR:
+            for (auto & item : zachlisp::form::get<zachlisp::form::Vector>(form)) {
+                nodes += count_nodes(item.form);
+            }
+            break;
+        case zachlisp::form::MAP:
+            for (auto & item : zachlisp::form::get<zachlisp::form::FormWrapperMap>(form)) {
+                nodes += count_nodes(item.first.form) + count_nodes(item.second.form);
+            }
+            break;
+        case zachlisp::form::SET:
+            for (auto & item : zachlisp::form::get<zachlisp::form::FormWrapperSet>(form)) {
+                nodes += count_nodes(item.form);
+            }
+            break;
+        default:
+            break;
+    }
+    return nodes;
+}
+
+void bench_nodes() {
+    std::string doc = make_document(4 * 1024 * 1024);
+    std::cout << "sizeof(FormWrapper): " << sizeof(zachlisp::form::FormWrapper) << " bytes" << std::endl;
+    for (bool view : {false, true}) {
+        std::string name = view ? "read_view" : "read";
+        std::size_t before = live_bytes;
+        auto forms = view ? zachlisp::read_view(doc) : zachlisp::read(doc);
+        std::size_t bytes = live_bytes - before;
+        std::size_t nodes = 0;
+        for (auto & form : forms) {
+            nodes += count_nodes(form);
+        }
+        std::cout << name << ": " << nodes << " nodes, " << static_cast<double>(bytes) / nodes << " bytes per node" << std::endl;
+    }
+}
+
+// the most allocations each node of a large literal may take to read,
+// evaluate and print. evaluating compiles the literal and goes through
+// chaiscript and back, so it allocates more, but none of the steps
+// should copy the literal
+const std::vector<std::pair<std::string, double>> COPY_BUDGETS = {
+    {"read", 2},
+    {"eval", 16},
+    {"print", 1},
+};
+
+void bench_copies() {
+    std::string doc = "[";
+    for (int i = 0; i < 20000; ++i) {
+        doc += "[" + std::to_string(i) + " 2.5 \"three\" {\"four\" [5 6]}] ";
+    }
+    doc += "]";
+
+    chaiscript::ChaiScript chai;
+    std::list<zachlisp::form::Form> forms;
+    std::list<zachlisp::form::Form> evaled;
+    std::size_t nodes = 0;
+    bool over = false;
+    for (auto & [name, budget] : COPY_BUDGETS) {
+        std::size_t before = allocations;
+        double secs = seconds([&] {
+            if (name == "read") {
+                forms = zachlisp::read(doc);
+                nodes = count_nodes(forms.front());
+            } else if (name == "eval") {
+                evaled = zachlisp::eval(forms, &chai);
+            } else {
+                zachlisp::print(evaled);
+            }
+        });
+        double per_node = static_cast<double>(allocations - before) / nodes;
+        report(name, doc.size(), secs);
+        std::cout << "  " << per_node << " allocations per node (budget " << budget << ")" << std::endl;
+        over = over || per_node > budget;
+    }
+    if (over) {
+        std::cout << "over budget!" << std::endl;
+        std::exit(1);
+    }
+}
+
+void bench_compile() {
+    chaiscript::ChaiScript chai;
+    auto forms = zachlisp::read("(+ 1 2)");
+    const long n = 100000;
+    long total = 0;
+
+    report("eval (+ 1 2) 100K times", 0, seconds([&] {
+        for (long i = 0; i < n; ++i) {
+            auto ret = zachlisp::eval(forms, &chai);
+            total += std::get<long>(ret.front().token().value);
+        }
+    }));
+
+    auto compiled = zachlisp::compile(forms.front(), &chai);
+    auto & node = *std::get<zachlisp::compiled::NodePtr>(compiled);
+    report("compile once, run 100K times", 0, seconds([&] {
+        for (long i = 0; i < n; ++i) {
+            total += chaiscript::boxed_cast<long>(zachlisp::run(node, &chai));
+        }
+    }));
+    std::cout << "total: " << total << std::endl;
+}
+
+void bench_arithmetic() {
+    // the arithmetic from tests/step2_eval.mal
+    chaiscript::ChaiScript chai;
+    auto forms = zachlisp::read(
+        "(+ 1 2) (+ 5 (* 2 3)) (- (+ 5 (* 2 3)) 3) (/ (- (+ 5 (* 2 3)) 3) 4)"
+        "(/ (- (+ 515 (* 87 311)) 302) 27) (* -3 6) (/ (- (+ 515 (* -87 311)) 296) 27)"
+    );
+    std::vector<zachlisp::compiled::NodePtr> nodes;
+    for (auto & form : forms) {
+        nodes.push_back(std::get<zachlisp::compiled::NodePtr>(zachlisp::compile(form, &chai)));
+    }
+    const long n = 100000;
+    long total = 0;
+    report("run step2 arithmetic 100K times", 0, seconds([&] {
+        for (long i = 0; i < n; ++i) {
+            for (auto & node : nodes) {
+                total += chaiscript::boxed_cast<long>(zachlisp::run(*node, &chai));
+            }
+        }
+    }));
+    std::cout << "total: " << total << std::endl;
+}
+
+void bench_closures() {
+    chaiscript::ChaiScript chai;
+    zachlisp::native::Runtime runtime(&chai);
+    zachlisp::eval(zachlisp::read(
+        "(def! sum2 (fn* (n acc) (if (= n 0) acc (sum2 (- n 1) (+ n acc)))))"
+        "(def! lets (fn* (n acc) (if (= n 0) acc (let* (a 1 b (+ a acc)) (lets (- n 1) b)))))"
+        "(def! fib (fn* (n) (if (< n 2) 1 (+ (fib (- n 1)) (fib (- n 2))))))"
+    ), runtime);
+    long total = 0;
+    for (auto & [name, source] : std::vector<std::pair<std::string, std::string>>{
+        {"1M tail calls", "(sum2 1000000 0)"},
+        {"1M tail calls with let*", "(lets 1000000 0)"},
+        {"fib 25", "(fib 25)"},
+    }) {
+        auto forms = zachlisp::read(source);
+        report(name, 0, seconds([&] {
+            total += zachlisp::eval(forms, runtime).front().token_long();
+        }));
+    }
+    std::cout << "total: " << total << std::endl;
+}
+
+// functions a let* binds that call themselves or each other hold each
+// other, so the memory still in use once 100K of them are made and dropped
+// has to stay under this
+const std::size_t LET_CYCLE_BUDGET = 1024 * 1024;
+
+void bench_let_cycles() {
+    const char *definitions =
+        "(def! self (fn* (n) (if (= n 0) n (do (let* [f (fn* [k] (if (= k 0) 0 (f (- k 1))))] (f 2)) (self (- n 1))))))"
+        "(def! mutual (fn* (n) (if (= n 0) n (do (let* [ev (fn* [k] (if (= k 0) true (od (- k 1)))) od (fn* [k] (if (= k 0) false (ev (- k 1))))] (ev 2)) (mutual (- n 1))))))"
+        "(def! escaping (fn* (n) (if (= n 0) n (do ((let* [ev (fn* [k] (if (= k 0) true (od (- k 1)))) od (fn* [k] (ev k))] od) 2) (escaping (- n 1))))))";
+    bool over = false;
+    for (auto [label, evaluator] : {std::make_pair("tree walker", zachlisp::Evaluator::TREE_WALKER), std::make_pair("bytecode", zachlisp::Evaluator::BYTECODE)}) {
+        chaiscript::ChaiScript chai;
+        zachlisp::native::Runtime runtime(&chai);
+        zachlisp::eval(zachlisp::read(definitions), runtime, evaluator);
+        for (auto name : {"self", "mutual", "escaping"}) {
+            auto forms = zachlisp::read(std::string("(") + name + " 100000)");
+            std::size_t before = live_bytes;
+            report(std::string("100K ") + name + " let* cycles (" + label + ")", 0, seconds([&] {
+                zachlisp::eval(forms, runtime, evaluator);
+            }));
+            std::size_t kept = live_bytes > before ? live_bytes - before : 0;
+            std::cout << "  " << kept << " bytes kept (budget " << LET_CYCLE_BUDGET << ")" << std::endl;
+            over = over || kept > LET_CYCLE_BUDGET;
+        }
+    }
+    if (over) {
+        std::cout << "over budget!" << std::endl;
+        std::exit(1);
+    }
+}
+
+void bench_evaluators() {
+    const char *definitions =
+        "(def! fib (fn* (n) (if (< n 2) 1 (+ (fib (- n 1)) (fib (- n 2))))))"
+        "(def! tak (fn* (x y z) (if (not (< y x)) z (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y)))))"
+        "(def! ack (fn* (m n) (if (= m 0) (+ n 1) (if (= n 0) (ack (- m 1) 1) (ack (- m 1) (ack m (- n 1)))))))"
+        "(def! range (fn* (n acc) (if (= n 0) acc (range (- n 1) (cons n acc)))))"
+        "(def! map (fn* (f xs) (if (empty? xs) xs (cons (f (first xs)) (map f (rest xs))))))"
+        "(def! filter (fn* (f xs) (if (empty? xs) xs (if (f (first xs)) (cons (first xs) (filter f (rest xs))) (filter f (rest xs))))))"
+        "(def! even? (fn* (n) (= n (* 2 (/ n 2)))))"
+        "(def! pipeline (fn* (n) (if (= n 0) 0 (+ (count (filter even? (map (fn* (x) (* x 3)) (range 1000 (list))))) (pipeline (- n 1))))))";
+    std::vector<std::pair<std::string, std::string>> programs = {
+        {"fib 25", "(fib 25)"},
+        {"tak 18 12 6", "(tak 18 12 6)"},
+        {"ackermann 2 9 x100", "(def! acks (fn* (n) (if (= n 0) 0 (+ (ack 2 9) (acks (- n 1)))))) (acks 100)"},
+        {"map/filter 1000 items x100", "(pipeline 100)"},
+    };
+    for (auto [label, evaluator] : {std::make_pair("tree walker", zachlisp::Evaluator::TREE_WALKER), std::make_pair("bytecode", zachlisp::Evaluator::BYTECODE)}) {
+        chaiscript::ChaiScript chai;
+        zachlisp::native::Runtime runtime(&chai);
+        zachlisp::eval(zachlisp::read(definitions), runtime, evaluator);
+        for (auto & [name, source] : programs) {
+            auto forms = zachlisp::read(source);
+            std::string result;
+            report(name + " (" + label + ")", 0, seconds([&] {
+                result = zachlisp::pr_str(zachlisp::eval(forms, runtime, evaluator).back());
+            }));
+            std::cout << "  = " << result << std::endl;
+        }
+    }
+}
+
+void bench_host_calls() {
+    chaiscript::ChaiScript chai;
+    long sum = 0;
+    chai.add(chaiscript::fun([&](long a, long b, long c) { sum += a + b + c; }), "add3");
+    zachlisp::native::Runtime runtime(&chai);
+    // the function returns nothing, so this is the cost of the calls
+    // rather than of converting what they return
+    zachlisp::eval(zachlisp::read(
+        "(def! calls (fn* (n) (if (= n 0) n (do (add3 n 1 2) (calls (- n 1))))))"
+    ), runtime, zachlisp::Evaluator::BYTECODE);
+    auto forms = zachlisp::read("(calls 1000000)");
+    report("1M calls of a 3-argument host function", 0, seconds([&] {
+        zachlisp::eval(forms, runtime, zachlisp::Evaluator::BYTECODE);
+    }));
+    std::cout << "sum: " << sum << std::endl;
+}
+
+void bench_chai_to_form() {
+    chaiscript::ChaiScript chai;
+    // 10K rows of a long, a double, a string, a bool, a char
+    // and a vector of three ints
+    std::vector<chaiscript::Boxed_Value> rows;
+    for (long i = 0; i < 10000; ++i) {
+        std::vector<chaiscript::Boxed_Value> inner = {
+            chaiscript::Boxed_Value(1), chaiscript::Boxed_Value(2), chaiscript::Boxed_Value(3)
+        };
+        rows.push_back(chaiscript::Boxed_Value(std::vector<chaiscript::Boxed_Value>{
+            chaiscript::Boxed_Value(i),
+            chaiscript::Boxed_Value(i * 0.5),
+            chaiscript::Boxed_Value(std::to_string(i)),
+            chaiscript::Boxed_Value(i % 2 == 0),
+            chaiscript::Boxed_Value('c'),
+            chaiscript::Boxed_Value(std::move(inner))
+        }));
+    }
+    chaiscript::Boxed_Value bv(std::move(rows));
+    std::size_t total = 0;
+    report("convert 10K rows of mixed values", 0, seconds([&] {
+        total += count_nodes(zachlisp::chai_to_form(bv, &chai));
+    }));
+    std::cout << "nodes: " << total << std::endl;
+}
+
+void bench_map_roundtrip() {
+    chaiscript::ChaiScript chai;
+    chai.add(chaiscript::fun([](const chaiscript::Boxed_Value & value) { return value; }), "identity");
+    zachlisp::native::Runtime runtime(&chai);
+    std::string map = "{", set = "#{";
+    for (long i = 0; i < 100000; ++i) {
+        map += ":k" + std::to_string(i) + " " + std::to_string(i) + " ";
+        set += "\"s" + std::to_string(i) + "\" ";
+    }
+    zachlisp::eval(zachlisp::read("(def! m " + map + "})"), runtime, zachlisp::Evaluator::BYTECODE);
+    zachlisp::eval(zachlisp::read("(def! s " + set + "})"), runtime, zachlisp::Evaluator::BYTECODE);
+    for (auto name : {"m", "s"}) {
+        auto forms = zachlisp::read(std::string("(count (identity ") + name + "))");
+        std::list<zachlisp::form::Form> ret;
+        report(std::string("100K entry ") + (name[0] == 'm' ? "map" : "set") + " through a host function", 0, seconds([&] {
+            ret = zachlisp::eval(forms, runtime, zachlisp::Evaluator::BYTECODE);
+        }));
+        std::cout << "count: " << zachlisp::print(ret);
+    }
+}
+
+void bench_vector_sharing() {
+    chaiscript::ChaiScript chai;
+    chai.add(chaiscript::fun([](const chaiscript::Boxed_Value & value) { return value; }), "identity");
+    zachlisp::native::Runtime runtime(&chai);
+    auto vec = zachlisp::form::Vector().transient();
+    for (long i = 0; i < 1000000; ++i) {
+        vec.push_back(zachlisp::form::FormWrapper{zachlisp::token::Token{i, zachlisp::token::type::NUMBER, 0, 0}});
+    }
+    runtime.define("v", vec.persistent());
+    auto forms = zachlisp::read("(count (identity (identity (identity (identity (identity v))))))");
+    std::list<zachlisp::form::Form> ret;
+    report("1M element vector through 5 host functions", 0, seconds([&] {
+        ret = zachlisp::eval(forms, runtime, zachlisp::Evaluator::BYTECODE);
+    }));
+    std::cout << "count: " << zachlisp::print(ret);
+}
+
+const std::vector<std::pair<std::string, std::function<void()>>> BENCHES = {
+    {"tokenize", bench_tokenize},
+    {"scan", bench_scan},
+    {"read_view", bench_read_view},
+    {"reader", bench_reader},
+    {"read_file", bench_read_file},
+    {"read_parallel", bench_read_parallel},
+    {"numbers", bench_numbers},
+    {"symbols", bench_symbols},
+    {"arena", bench_arena},
+    {"hash", bench_hash},
+    {"map", bench_map},
+    {"vector", bench_vector},
+    {"list", bench_list},
+    {"nodes", bench_nodes},
+    {"copies", bench_copies},
+    {"compile", bench_compile},
+    {"arithmetic", bench_arithmetic},
+    {"closures", bench_closures},
+    {"let_cycles", bench_let_cycles},
+    {"evaluators", bench_evaluators},
+    {"host_calls", bench_host_calls},
+    {"chai_to_form", bench_chai_to_form},
+    {"map_roundtrip", bench_map_roundtrip},
+    {"vector_sharing", bench_vector_sharing},
+};
+
+// runs every benchmark, or only the ones named on the command line
+int main(int argc, char* argv[]) {
+    for (auto & [name, fn] : BENCHES) {
+        if (argc < 2 || std::find(argv + 1, argv + argc, name) != argv + argc) {
+            std::cout << "== " << name << std::endl;
+            fn();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,2 @@
+#!/bin/bash
+g++ bench.cpp -O3 -ldl -lpthread -o ${1:-zachlisp-bench} -std=c++17 && ./${1:-zachlisp-bench} "${@:2}"
@@ -1,6 +1,12 @@
 #pragma once
 
 #include <functional>
+#include <iostream>
+#include <typeindex>
+#include <unordered_map>
+#if __has_include(<sys/resource.h>)
+#include <sys/resource.h>
+#endif
 
 #include "read.hpp"
 #include "print.hpp"
@@ -8,331 +14,1841 @@
 
 namespace zachlisp {
 
-    namespace evaled {
-
-        namespace fn {
-
-        enum Type {ZERO, ONE, TWO, THREE, FOUR, FIVE, SIX};
-
-        using Zero = std::function<chaiscript::Boxed_Value()>;
-        using One = std::function<chaiscript::Boxed_Value(chaiscript::Boxed_Value)>;
-        using Two = std::function<chaiscript::Boxed_Value(chaiscript::Boxed_Value, chaiscript::Boxed_Value)>;
-        using Three = std::function<chaiscript::Boxed_Value(chaiscript::Boxed_Value, chaiscript::Boxed_Value, chaiscript::Boxed_Value)>;
-        using Four = std::function<chaiscript::Boxed_Value(chaiscript::Boxed_Value, chaiscript::Boxed_Value, chaiscript::Boxed_Value, chaiscript::Boxed_Value)>;
-        using Five = std::function<chaiscript::Boxed_Value(chaiscript::Boxed_Value, chaiscript::Boxed_Value, chaiscript::Boxed_Value, chaiscript::Boxed_Value, chaiscript::Boxed_Value)>;
-        using Six = std::function<chaiscript::Boxed_Value(chaiscript::Boxed_Value, chaiscript::Boxed_Value, chaiscript::Boxed_Value, chaiscript::Boxed_Value, chaiscript::Boxed_Value, chaiscript::Boxed_Value)>;
-
-        }
-
-    enum Type {SPECIAL, CHAI};
-    using Maybe = std::variant<form::Special, chaiscript::Boxed_Value>;
-
-    }
-
 const std::unordered_set<char> OPERATORS = {'+', '-', '*', '/'};
 
-chaiscript::Boxed_Value eval_token(token::Token token, chaiscript::ChaiScript* chai) {
+// literals are shared by every evaluation of a compiled form,
+// so like chaiscript's own they can't be changed
+chaiscript::Boxed_Value eval_token(const token::Token & token) {
     switch (token.value.index()) {
         case token::value::BOOL:
-            return chaiscript::Boxed_Value(std::get<bool>(token.value));
+            return chaiscript::const_var(std::get<bool>(token.value));
         case token::value::CHAR:
             return chaiscript::Boxed_Value(1, std::get<char>(token.value));
         case token::value::LONG:
-            return chaiscript::Boxed_Value(std::get<long>(token.value));
+            return chaiscript::const_var(std::get<long>(token.value));
         case token::value::DOUBLE:
-            return chaiscript::Boxed_Value(std::get<double>(token.value));
-        default: //case token::value::STRING:
+            return chaiscript::const_var(std::get<double>(token.value));
+        // chaiscript has no arbitrary precision numbers,
+        // so these become the closest long or double
+        case token::value::BIG_INT:
             {
-                auto s = std::get<std::string>(token.value);
-                if (token.type == token::type::SYMBOL) {
-                    return chai->eval(s);
-                } else {
-                    return chaiscript::Boxed_Value(s);
+                auto & s = std::get<token::value::BigInt>(token.value).text;
+                long l;
+                auto ret = std::from_chars(s.data(), s.data() + s.size(), l);
+                if (ret.ec == std::errc() && ret.ptr == s.data() + s.size()) {
+                    return chaiscript::const_var(l);
                 }
+                return chaiscript::const_var(std::strtod(s.c_str(), nullptr));
+            }
+        case token::value::BIG_DECIMAL:
+            return chaiscript::const_var(std::strtod(std::get<token::value::BigDecimal>(token.value).text.c_str(), nullptr));
+        case token::value::RATIO:
+            {
+                auto ratio = std::get<token::value::Ratio>(token.value);
+                return chaiscript::const_var(static_cast<double>(ratio.numerator) / ratio.denominator);
             }
+        default: //case token::value::STRING, token::value::VIEW, token::value::SYMBOL:
+            // symbols are compiled into lookups, so only strings get here
+            return chaiscript::const_var(std::string(token::value::text(token.value)));
     }
 }
 
-form::Form chai_to_form(chaiscript::Boxed_Value bv, chaiscript::ChaiScript* chai);
+form::Form chai_to_form(const chaiscript::Boxed_Value & bv, chaiscript::ChaiScript* chai);
+
+    // zachlisp vectors, maps and sets are handed to chaiscript as they are,
+    // so they cross over by sharing the collection rather than copying it
+    namespace shared {
+
+    struct Vector {
+        form::Form form;
+    };
+
+    struct Map {
+        form::Form form;
+    };
+
+    struct Set {
+        form::Form form;
+    };
+
+    // a vector walked from either end, like the ranges bootstrap_stl gives containers
+    struct VectorRange {
+        form::Form form;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    }
+
+    // forms are compiled into chaiscript syntax trees once, and the trees
+    // are evaluated as many times as needed without going near the parser
+    namespace compiled {
+
+    using Tracer = chaiscript::eval::Noop_Tracer;
+    using Node = chaiscript::eval::AST_Node_Impl<Tracer>;
+    using NodePtr = chaiscript::eval::AST_Node_Impl_Ptr<Tracer>;
+    using Nodes = std::vector<NodePtr>;
+
+    enum Type {SPECIAL, NODE};
+    using Maybe = std::variant<form::Special, NodePtr>;
+
+    // every node shares one file name rather than allocating its own
+    chaiscript::Parse_Location make_location(int line = 0, int column = 0) {
+        static auto filename = std::make_shared<std::string>("__EVAL__");
+        return chaiscript::Parse_Location(filename, line, column, line, column);
+    }
+
+    // chaiscript's own inline arrays and maps clone every item they are
+    // given, which goes through function dispatch for anything but numbers.
+    // these put the items in as they are, the way zachlisp always has.
+
+    struct Inline_Vector_AST_Node final : Node {
+        Inline_Vector_AST_Node(Nodes items) : Node("", chaiscript::AST_Node_Type::Inline_Array, make_location(), std::move(items)) {}
+
+    protected:
+        chaiscript::Boxed_Value eval_internal(const chaiscript::detail::Dispatch_State & t_ss) const override {
+            std::vector<chaiscript::Boxed_Value> vec;
+            vec.reserve(children.size());
+            for (auto & child : children) {
+                vec.push_back(child->eval(t_ss));
+            }
+            return chaiscript::Boxed_Value(std::move(vec));
+        }
+    };
+
+    // maps and sets are built as zachlisp collections, since chaiscript's
+    // maps can only have strings for keys and it has no sets at all.
+    // the children of a map are its keys and values, one after the other
+    struct Inline_Map_AST_Node final : Node {
+        chaiscript::ChaiScript* chai;
+
+        Inline_Map_AST_Node(Nodes items, chaiscript::ChaiScript* c) : Node("", chaiscript::AST_Node_Type::Inline_Map, make_location(), std::move(items)), chai(c) {}
 
-evaled::Maybe form_to_chai(form::Form form, chaiscript::ChaiScript* chai) {
+    protected:
+        chaiscript::Boxed_Value eval_internal(const chaiscript::detail::Dispatch_State & t_ss) const override {
+            auto map = form::FormWrapperMap().transient();
+            for (std::size_t i = 0; i + 1 < children.size(); i += 2) {
+                auto key = chai_to_form(children[i]->eval(t_ss), chai);
+                map.insert(form::FormWrapper{std::move(key)}, form::FormWrapper{chai_to_form(children[i + 1]->eval(t_ss), chai)});
+            }
+            return chaiscript::Boxed_Value(shared::Map{map.persistent()});
+        }
+    };
+
+    struct Inline_Set_AST_Node final : Node {
+        chaiscript::ChaiScript* chai;
+
+        Inline_Set_AST_Node(Nodes items, chaiscript::ChaiScript* c) : Node("", chaiscript::AST_Node_Type::Inline_Map, make_location(), std::move(items)), chai(c) {}
+
+    protected:
+        chaiscript::Boxed_Value eval_internal(const chaiscript::detail::Dispatch_State & t_ss) const override {
+            auto set = form::FormWrapperSet().transient();
+            for (auto & child : children) {
+                set.insert(form::FormWrapper{chai_to_form(child->eval(t_ss), chai)});
+            }
+            return chaiscript::Boxed_Value(shared::Set{set.persistent()});
+        }
+    };
+
+    }
+
+// words chaiscript's parser gives a meaning of their own
+const std::unordered_set<std::string_view> CHAI_KEYWORDS = {
+    "def", "fun", "while", "for", "if", "else", "auto", "return", "break", "continue",
+    "true", "false", "class", "attr", "var", "global", "GLOBAL", "_", "try", "catch",
+    "finally", "switch", "case", "default", "__LINE__", "__FILE__", "__FUNC__", "__CLASS__"
+};
+
+bool is_chai_identifier(std::string_view name) {
+    if (name.empty() || CHAI_KEYWORDS.count(name) || std::isdigit(static_cast<unsigned char>(name[0]))) {
+        return false;
+    }
+    return std::all_of(name.begin(), name.end(), [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    });
+}
+
+chaiscript::Parse_Location location(const form::Form & form) {
+    if (form.index() == form::TOKEN) {
+        auto token = form.token();
+        return compiled::make_location(token.line, token.column);
+    }
+    return compiled::make_location();
+}
+
+compiled::NodePtr compile_symbol(const form::Form & form, chaiscript::ChaiScript* chai) {
+    std::string name(form.text());
+    if (is_chai_identifier(name)) {
+        return std::make_unique<chaiscript::eval::Id_AST_Node<compiled::Tracer>>(name, location(form));
+    }
+    // anything else means whatever chaiscript makes of it, which is
+    // worked out here once rather than every time the symbol is evaluated
+    auto ast = chai->get_parser().parse(name, "__EVAL__");
+    return compiled::NodePtr(dynamic_cast<compiled::Node*>(ast.release()));
+}
+
+compiled::Maybe compile(const form::Form & form, chaiscript::ChaiScript* chai);
+
+// compiles each of the forms onto the end of nodes,
+// and returns the first error if there is one
+template <class T>
+std::optional<form::Special> compile_all(const T & forms, compiled::Nodes & nodes, chaiscript::ChaiScript* chai) {
+    for (auto & item : forms) {
+        auto ret = compile(item.form, chai);
+        switch (ret.index()) {
+            case compiled::SPECIAL:
+                return std::get<form::Special>(std::move(ret));
+            case compiled::NODE:
+                nodes.push_back(std::get<compiled::NodePtr>(std::move(ret)));
+                break;
+        }
+    }
+    return std::nullopt;
+}
+
+compiled::NodePtr make_arg_list(compiled::Nodes args) {
+    return std::make_unique<chaiscript::eval::Arg_List_AST_Node<compiled::Tracer>>("", compiled::make_location(), std::move(args));
+}
+
+compiled::NodePtr make_call(const std::string & fn_name, compiled::NodePtr fn, compiled::Nodes args) {
+    compiled::Nodes children;
+    children.push_back(std::move(fn));
+    children.push_back(make_arg_list(std::move(args)));
+    return std::make_unique<chaiscript::eval::Fun_Call_AST_Node<compiled::Tracer>>(fn_name, compiled::make_location(), std::move(children));
+}
+
+compiled::Maybe compile_list(const form::Form & form, chaiscript::ChaiScript* chai) {
+    auto & list = form::get<form::List>(form);
+    if (list.size() == 0) {
+        return form::Special{"RuntimeError", "Empty list", std::nullopt};
+    }
+    auto & first_form = list.front().form;
+
+    compiled::Nodes args;
+    if (auto error = compile_all(list.rest(), args, chai)) {
+        return *error;
+    }
+
+    std::string fn_name = "";
+    if (first_form.index() == form::TOKEN && first_form.token_type() == token::type::SYMBOL) {
+        fn_name = first_form.text();
+    }
+
+    if (fn_name.size() == 1 && OPERATORS.find(fn_name.at(0)) != OPERATORS.end()) {
+        if (args.size() < 2) {
+            return form::Special{"RuntimeError", "Invalid number of arguments function " + fn_name, std::nullopt};
+        }
+        // operators take two arguments, so more than that are folded from the left.
+        // like chaiscript's own operators, numbers are worked out directly and
+        // anything else calls the operator function, found once per node
+        auto ret = std::move(args[0]);
+        for (std::size_t i = 1; i < args.size(); ++i) {
+            compiled::Nodes pair;
+            pair.push_back(std::move(ret));
+            pair.push_back(std::move(args[i]));
+            ret = std::make_unique<chaiscript::eval::Binary_Operator_AST_Node<compiled::Tracer>>(fn_name, location(first_form), std::move(pair));
+        }
+        return ret;
+    }
+
+    auto fn = compile(first_form, chai);
+    switch (fn.index()) {
+        case compiled::SPECIAL:
+            return fn;
+    }
+    return make_call(fn_name, std::get<compiled::NodePtr>(std::move(fn)), std::move(args));
+}
+
+compiled::Maybe compile(const form::Form & form, chaiscript::ChaiScript* chai) {
     switch (form.index()) {
         case form::SPECIAL:
-            return std::get<form::Special>(form);
+            return form::get<form::Special>(form);
         case form::TOKEN:
-            {
-                auto token = std::get<token::Token>(form);
-                return eval_token(token, chai);
+            if (form.token_type() == token::type::SYMBOL && token::value::is_text(form.value_type())) {
+                return compile_symbol(form, chai);
             }
+            return std::make_unique<chaiscript::eval::Constant_AST_Node<compiled::Tracer>>("", location(form), eval_token(form.token()));
         case form::LIST:
+            return compile_list(form, chai);
+        case form::VECTOR:
             {
-                auto list = std::get<std::list<form::FormWrapper>>(form);
-                if (list.size() == 0) {
-                    return form::Special{"RuntimeError", "Empty list", std::nullopt};
-                } else {
-                    auto first_form = list.front().form;
-                    list.pop_front();
-
-                    std::vector<chaiscript::Boxed_Value> args;
-                    for (auto it = list.begin(); it != list.end(); ++it) {
-                        auto ret = form_to_chai((*it).form, chai);
+                compiled::Nodes items;
+                if (auto error = compile_all(form::get<form::Vector>(form), items, chai)) {
+                    return *error;
+                }
+                return std::make_unique<compiled::Inline_Vector_AST_Node>(std::move(items));
+            }
+        case form::MAP:
+            {
+                compiled::Nodes items;
+                for (auto & item : form::get<form::FormWrapperMap>(form)) {
+                    for (auto & fw : {item.first, item.second}) {
+                        auto ret = compile(fw.form, chai);
                         switch (ret.index()) {
-                            case evaled::SPECIAL:
+                            case compiled::SPECIAL:
                                 return ret;
-                            case evaled::CHAI:
-                                {
-                                    args.push_back(std::get<chaiscript::Boxed_Value>(ret));
-                                    break;
-                                }
                         }
+                        items.push_back(std::get<compiled::NodePtr>(std::move(ret)));
                     }
+                }
+                return std::make_unique<compiled::Inline_Map_AST_Node>(std::move(items), chai);
+            }
+        case form::SET:
+            {
+                compiled::Nodes items;
+                if (auto error = compile_all(form::get<form::FormWrapperSet>(form), items, chai)) {
+                    return *error;
+                }
+                return std::make_unique<compiled::Inline_Set_AST_Node>(std::move(items), chai);
+            }
+        default:
+            break;
+    }
+    return form::Special{"RuntimeError", "Form not recognized", std::nullopt};
+}
 
-                    std::string fn_name = "";
-                    if (first_form.index() == form::TOKEN) {
-                        auto token = std::get<token::Token>(first_form);
-                        if (token.type == token::type::SYMBOL) {
-                            fn_name = std::get<std::string>(token.value);
-                        }
+// evaluates a compiled form, which can be done any number of times
+chaiscript::Boxed_Value run(const compiled::Node & node, chaiscript::ChaiScript* chai) {
+    try {
+        return chai->eval(node);
+    } catch (chaiscript::eval::detail::Return_Value & rv) {
+        return std::move(rv.retval);
+    } catch (const chaiscript::Boxed_Value & bv) {
+        // errors come out boxed, so they are unboxed to be reported like any other
+        if (bv.get_type_info().bare_equal(chaiscript::user_type<chaiscript::exception::eval_error>())) {
+            throw chaiscript::boxed_cast<const chaiscript::exception::eval_error &>(bv);
+        }
+        throw;
+    }
+}
+
+// turns a boxed value of one bare type into a form
+using ChaiConverter = std::function<form::Form(const chaiscript::Boxed_Value &, chaiscript::ChaiScript*)>;
+
+namespace converters {
+
+    // the table has matched the bare type, so the value can be read in place
+    template <class T>
+    const T & unbox(const chaiscript::Boxed_Value & bv) {
+        return *static_cast<const T*>(bv.get_const_ptr());
+    }
+
+    template <class T>
+    form::Form number(const chaiscript::Boxed_Value & bv, chaiscript::ChaiScript*) {
+        if constexpr (std::is_floating_point_v<T>) {
+            return token::Token{static_cast<double>(unbox<T>(bv)), token::type::NUMBER, 0, 0};
+        } else {
+            return token::Token{static_cast<long>(unbox<T>(bv)), token::type::NUMBER, 0, 0};
+        }
+    }
+
+    template <class ... T>
+    void add_numbers(std::unordered_map<std::type_index, ChaiConverter> & table) {
+        (table.emplace(std::type_index(typeid(T)), number<T>), ...);
+    }
+
+    form::Form vector(const chaiscript::Boxed_Value & bv, chaiscript::ChaiScript* chai) {
+        auto & vec = unbox<std::vector<chaiscript::Boxed_Value>>(bv);
+        auto new_vec = form::Vector().transient();
+
+        for (auto it = vec.begin(); it != vec.end(); ++it) {
+            new_vec.push_back(form::FormWrapper{chai_to_form(*it, chai)});
+        }
+
+        return new_vec.persistent();
+    }
+
+    // chaiscript's own maps, whose keys are always strings
+    form::Form map(const chaiscript::Boxed_Value & bv, chaiscript::ChaiScript* chai) {
+        auto & map = unbox<std::map<std::string, chaiscript::Boxed_Value>>(bv);
+        auto new_map = form::FormWrapperMap().transient();
+
+        for (auto it = map.begin(); it != map.end(); ++it) {
+            auto key = form::FormWrapper{token::Token{it->first, token::type::STRING, 0, 0}};
+            new_map.insert(std::move(key), form::FormWrapper{chai_to_form(it->second, chai)});
+        }
+
+        return new_map.persistent();
+    }
+
+    std::unordered_map<std::type_index, ChaiConverter> make_table() {
+        std::unordered_map<std::type_index, ChaiConverter> table;
+        add_numbers<
+            short, unsigned short, int, unsigned int, long, unsigned long,
+            long long, unsigned long long, signed char, unsigned char,
+            float, double, long double
+        >(table);
+        table.emplace(std::type_index(typeid(bool)), [](auto & bv, auto) -> form::Form {
+            return token::Token{unbox<bool>(bv), token::type::SYMBOL, 0, 0};
+        });
+        table.emplace(std::type_index(typeid(char)), [](auto & bv, auto) -> form::Form {
+            return token::Token{unbox<char>(bv), token::type::STRING, 0, 0};
+        });
+        table.emplace(std::type_index(typeid(std::string)), [](auto & bv, auto) -> form::Form {
+            return token::Token{unbox<std::string>(bv), token::type::STRING, 0, 0};
+        });
+        table.emplace(std::type_index(typeid(std::vector<chaiscript::Boxed_Value>)), vector);
+        table.emplace(std::type_index(typeid(std::map<std::string, chaiscript::Boxed_Value>)), map);
+        table.emplace(std::type_index(typeid(shared::Vector)), [](auto & bv, auto) {
+            return unbox<shared::Vector>(bv).form;
+        });
+        table.emplace(std::type_index(typeid(shared::Map)), [](auto & bv, auto) {
+            return unbox<shared::Map>(bv).form;
+        });
+        table.emplace(std::type_index(typeid(shared::Set)), [](auto & bv, auto) {
+            return unbox<shared::Set>(bv).form;
+        });
+        table.emplace(std::type_index(typeid(chaiscript::dispatch::Proxy_Function_Base)), [](auto &, auto) -> form::Form {
+            return form::Special{"Object", "function", std::nullopt};
+        });
+        return table;
+    }
+
+}
+
+std::unordered_map<std::type_index, ChaiConverter> & chai_converters() {
+    static std::unordered_map<std::type_index, ChaiConverter> table = converters::make_table();
+    return table;
+}
+
+// registers how values of a type added to chaiscript come back as forms
+template <class T>
+void add_chai_converter(ChaiConverter converter) {
+    chai_converters()[std::type_index(typeid(T))] = std::move(converter);
+}
+
+form::Form chai_to_form(const chaiscript::Boxed_Value & bv, chaiscript::ChaiScript* chai) {
+    if (bv.is_null()) {
+        return token::Token{token::value::intern("nil"), token::type::SYMBOL, 0, 0};
+    }
+
+    auto & table = chai_converters();
+    auto it = table.find(std::type_index(*bv.get_type_info().bare_type_info()));
+    if (it == table.end()) {
+        return form::Special{"RuntimeError", "Value not recognized", std::nullopt};
+    }
+    return it->second(bv, chai);
+}
+
+std::list<form::Form> eval(const std::list<form::Form> & forms, chaiscript::ChaiScript* chai) {
+    std::list<form::Form> new_forms;
+    for (auto & form : forms) {
+        try {
+            auto compiled_form = compile(form, chai);
+            switch (compiled_form.index()) {
+                case compiled::SPECIAL:
+                    {
+                        new_forms.push_back(std::move(std::get<form::Special>(compiled_form)));
+                        break;
+                    }
+                case compiled::NODE:
+                    {
+                        new_forms.push_back(chai_to_form(run(*std::get<compiled::NodePtr>(compiled_form), chai), chai));
+                        break;
                     }
+            }
+        } catch (const chaiscript::exception::eval_error &e) {
+            new_forms.push_back(form::Special{"RuntimeError", e.what(), std::nullopt});
+        } catch (const chaiscript::exception::arithmetic_error &e) {
+            new_forms.push_back(form::Special{"RuntimeError", e.what(), std::nullopt});
+        } catch (const chaiscript::exception::bad_boxed_cast &e) {
+            new_forms.push_back(form::Special{"RuntimeError", e.what(), std::nullopt});
+        } catch (const chaiscript::detail::exception::bad_any_cast &e) {
+            new_forms.push_back(form::Special{"RuntimeError", e.what(), std::nullopt});
+        }
+    }
+    return new_forms;
+}
 
-                    if (fn_name.size() == 1 && OPERATORS.find(fn_name.at(0)) != OPERATORS.end()) {
-                        if (args.size() >= 2) {
-                            auto fn = chai->eval<evaled::fn::Two>("`" + fn_name + "`");
-                            auto ret = fn(args[0], args[1]);
-                            for (int i = 2; i < args.size(); i++) {
-                                ret = fn(ret, args[i]);
-                            }
-                            return ret;
-                        }
-                    } else {
-                        auto ret = form_to_chai(first_form, chai);
-                        switch (ret.index()) {
-                            case evaled::SPECIAL:
-                                return ret;
-                            case evaled::CHAI:
-                                {
-                                    auto chai_fn = std::get<chaiscript::Boxed_Value>(ret);
-
-                                    switch (args.size()) {
-                                        case evaled::fn::ZERO:
-                                            {
-                                                auto fn = chai->boxed_cast<evaled::fn::Zero>(chai_fn);
-                                                return fn();
-                                            }
-                                        case evaled::fn::ONE:
-                                            {
-                                                auto fn = chai->boxed_cast<evaled::fn::One>(chai_fn);
-                                                return fn(args[0]);
-                                            }
-                                        case evaled::fn::TWO:
-                                            {
-                                                auto fn = chai->boxed_cast<evaled::fn::Two>(chai_fn);
-                                                return fn(args[0], args[1]);
-                                            }
-                                        case evaled::fn::THREE:
-                                            {
-                                                auto fn = chai->boxed_cast<evaled::fn::Three>(chai_fn);
-                                                return fn(args[0], args[1], args[2]);
-                                            }
-                                        case evaled::fn::FOUR:
-                                            {
-                                                auto fn = chai->boxed_cast<evaled::fn::Four>(chai_fn);
-                                                return fn(args[0], args[1], args[2], args[3]);
-                                            }
-                                        case evaled::fn::FIVE:
-                                            {
-                                                auto fn = chai->boxed_cast<evaled::fn::Five>(chai_fn);
-                                                return fn(args[0], args[1], args[2], args[3], args[4]);
-                                            }
-                                        case evaled::fn::SIX:
-                                            {
-                                                auto fn = chai->boxed_cast<evaled::fn::Six>(chai_fn);
-                                                return fn(args[0], args[1], args[2], args[3], args[4], args[5]);
-                                            }
-                                    }
-                                }
+    // zachlisp's own evaluator. forms are analyzed once into trees of
+    // expressions, with every local resolved to a slot in a frame and every
+    // global to the cell that holds it, so running them never looks up a
+    // name or boxes a value. chaiscript is only used for the names
+    // zachlisp doesn't define itself.
+    namespace native {
+
+    using Name = token::value::Name;
+
+    struct Expr;
+    using ExprPtr = std::unique_ptr<Expr>;
+    using Exprs = std::vector<ExprPtr>;
+
+    form::Special error(std::string message) {
+        return form::Special{"RuntimeError", std::move(message), std::nullopt};
+    }
+
+    const form::Form & nil() {
+        static const form::Form NIL(token::Token{token::value::intern("nil"), token::type::SYMBOL, 0, 0});
+        return NIL;
+    }
+
+    // the locals of one call of a function, or of one top-level form, or
+    // the values a closure captured. a call's frame finds the values its
+    // closure captured through captured. closures capture the values they
+    // use rather than the frame they're made in, so a closure kept in that
+    // frame doesn't keep the frame alive
+    struct Env {
+        std::vector<form::Form> slots;
+        std::shared_ptr<Env> captured;
+    };
+
+    using EnvPtr = std::shared_ptr<Env>;
+
+    // a local is the slot at index in the frame (depth 0), or in what the
+    // frame's closure captured (depth 1). if it's a cell, its value is
+    // the one in the cell
+    struct Slot {
+        std::size_t depth;
+        std::size_t index;
+        bool cell = false;
+    };
+
+    // a let* binding that a closure uses before it's bound, like one of two
+    // functions that call each other. the binding's slot holds the cell from
+    // the start of the let*, so the closure can capture it, and the value is
+    // put in it when it's bound. cells are only ever seen by the evaluators
+    struct Cell : form::Callable {
+        form::Form value = nil();
+    };
+
+    form::Form make_cell() {
+        return form::Fn(std::make_unique<Cell>());
+    }
+
+    Cell & cell(const form::Form & form) {
+        return static_cast<Cell &>(*form::get<form::Fn>(form));
+    }
+
+    // a global, which is made the first time its name is analyzed,
+    // whether or not it has been defined yet
+    struct Global {
+        const Name *name;
+        std::optional<form::Form> value;
+    };
+
+    // the parameters and body of a fn*. the frame holds the parameters
+    // first, then the rest parameter if there is one, then every let* in it.
+    // captures are where the closure's values come from in the function
+    // it's made in. a fn* bound by a let* that refers to itself has its own
+    // closure put in the self slot when it's called, rather than capturing
+    // the cell it's bound to, which would keep it alive forever
+    struct Lambda {
+        std::size_t params;
+        bool variadic;
+        std::size_t frame_size;
+        ExprPtr body;
+        std::vector<Slot> captures;
+        std::optional<std::size_t> self;
+    };
+
+    enum Kind {CONSTANT, LOCAL, GLOBAL, IF, DO, LET, LAMBDA, DEF, CALL, VECTOR, MAP, SET};
+
+    struct Expr {
+        Kind kind;
+        Exprs children;
+        // CONSTANT
+        form::Form value = nil();
+        // LOCAL
+        Slot slot{};
+        // LET, where the first children are the values
+        // of the bindings, and the last is the body
+        std::vector<Slot> slots;
+        // GLOBAL and DEF
+        Global *global = nullptr;
+        // LAMBDA
+        std::shared_ptr<const Lambda> lambda;
+
+        Expr(Kind k) : kind(k) {}
+    };
+
+    // builtins are given their arguments in place, without copying them
+    using Builtin = form::Form (*)(const form::Form *args, std::size_t count);
+
+    struct Runtime;
+
+    // evaluators call the kinds of function they know about themselves,
+    // and anything else through call, which is given the form holding
+    // the function. the arguments can be moved from
+    struct Function : form::Callable {
+        enum Kind {CLOSURE, BUILTIN, HOST, BYTECODE};
+
+        Kind kind;
+
+        Function(Kind k) : kind(k) {}
+
+        virtual form::Form call(const form::Form & self, form::Form *args, std::size_t count, Runtime & runtime) const = 0;
+
+        // what a closure captured, if this is one
+        virtual const EnvPtr * captured() const {
+            return nullptr;
+        }
+    };
+
+    struct Closure : Function {
+        std::shared_ptr<const Lambda> lambda;
+        EnvPtr env;
+
+        Closure(std::shared_ptr<const Lambda> l, EnvPtr e) : Function(CLOSURE), lambda(std::move(l)), env(std::move(e)) {}
+
+        form::Form call(const form::Form & self, form::Form *args, std::size_t count, Runtime & runtime) const override;
+
+        const EnvPtr * captured() const override {
+            return &env;
+        }
+    };
+
+    struct BuiltinFn : Function {
+        std::string name;
+        Builtin fn;
+
+        BuiltinFn(std::string n, Builtin f) : Function(BUILTIN), name(std::move(n)), fn(f) {}
+
+        form::Form call(const form::Form &, form::Form *args, std::size_t count, Runtime &) const override {
+            return fn(args, count);
+        }
+    };
+
+    struct HostFn : Function {
+        std::string name;
+        chaiscript::Boxed_Value fn;
+        // the function in fn, which is called directly
+        // with however many arguments it is given
+        chaiscript::Const_Proxy_Function proxy;
+
+        HostFn(std::string n, chaiscript::Boxed_Value f, chaiscript::Const_Proxy_Function p) : Function(HOST), name(std::move(n)), fn(std::move(f)), proxy(std::move(p)) {}
+
+        form::Form call(const form::Form & self, form::Form *args, std::size_t count, Runtime & runtime) const override;
+    };
+
+    const Function & function(const form::Form & form) {
+        return static_cast<const Function &>(*form::get<form::Fn>(form));
+    }
+
+    // functions a let* binds can hold each other through their cells, which
+    // counting references never frees. this finds the cells, closures and
+    // captured values that nothing but the given cells and each other hold,
+    // and empties the cells among them
+    void release_cells(const std::vector<form::Form> & cells) {
+        struct Node {
+            std::size_t references;
+            // how many of the references are from the cells or other nodes
+            std::size_t internal = 0;
+            std::vector<const void *> edges;
+            bool live = false;
+            form::Callable *callable = nullptr;
+            const Env *env = nullptr;
+        };
+        std::unordered_map<const void *, Node> nodes;
+        std::vector<const void *> work;
+
+        auto add = [&](std::vector<const void *> & edges, const void *key, std::size_t references) -> Node * {
+            edges.push_back(key);
+            auto [it, added] = nodes.try_emplace(key);
+            ++it->second.internal;
+            if (!added) {
+                return nullptr;
+            }
+            it->second.references = references;
+            work.push_back(key);
+            return &it->second;
+        };
+        auto follow = [&](std::vector<const void *> & edges, const form::Form & form) {
+            if (form.index() == form::FN) {
+                if (auto node = add(edges, form.object(), form.object()->references.load())) {
+                    node->callable = form::get<form::Fn>(form).get();
+                }
+            }
+        };
+        auto follow_env = [&](std::vector<const void *> & edges, const EnvPtr & env) {
+            if (env) {
+                if (auto node = add(edges, env.get(), env.use_count())) {
+                    node->env = env.get();
+                }
+            }
+        };
+
+        std::vector<const void *> roots;
+        for (auto & cell : cells) {
+            follow(roots, cell);
+        }
+        while (!work.empty()) {
+            auto & node = nodes[work.back()];
+            work.pop_back();
+            std::vector<const void *> edges;
+            if (node.env) {
+                for (auto & slot : node.env->slots) {
+                    follow(edges, slot);
+                }
+                follow_env(edges, node.env->captured);
+            } else if (auto c = dynamic_cast<Cell *>(node.callable)) {
+                follow(edges, c->value);
+            } else if (auto captured = static_cast<const Function *>(node.callable)->captured()) {
+                follow_env(edges, *captured);
+            }
+            node.edges = std::move(edges);
+        }
+
+        // anything held from elsewhere is live, and so is everything it holds
+        for (auto & [key, node] : nodes) {
+            if (node.references > node.internal && !node.live) {
+                node.live = true;
+                work.push_back(key);
+                while (!work.empty()) {
+                    auto & live = nodes[work.back()];
+                    work.pop_back();
+                    for (auto edge : live.edges) {
+                        if (!nodes[edge].live) {
+                            nodes[edge].live = true;
+                            work.push_back(edge);
                         }
                     }
+                }
+            }
+        }
 
-                    return form::Special{"RuntimeError", "Invalid number of arguments function " + fn_name, std::nullopt};
+        // the values are only let go once every cell is empty, since
+        // letting one go can free the others
+        std::vector<form::Form> values;
+        for (auto & [key, node] : nodes) {
+            if (!node.live && node.callable) {
+                if (auto c = dynamic_cast<Cell *>(node.callable)) {
+                    values.push_back(std::move(c->value));
+                    c->value = nil();
                 }
             }
-        case form::VECTOR:
-            {
-                auto vec = std::get<std::vector<form::FormWrapper>>(form);
-                auto new_vec = std::vector<chaiscript::Boxed_Value>();
+        }
+    }
 
-                for (auto it = vec.begin(); it != vec.end(); ++it) {
-                    auto ret = form_to_chai((*it).form, chai);
-                    switch (ret.index()) {
-                        case evaled::SPECIAL:
-                            return ret;
-                        case evaled::CHAI:
-                            {
-                                new_vec.push_back(std::get<chaiscript::Boxed_Value>(ret));
-                                break;
-                            }
+    struct Runtime {
+        chaiscript::ChaiScript *chai;
+        // every global that has been analyzed, keyed by its interned name
+        std::unordered_map<const Name *, std::unique_ptr<Global>> globals;
+        // the arguments of the calls being made. they are pushed as they
+        // are evaluated, and a call takes the ones on top
+        std::vector<form::Form> stack;
+        // the registers of the bytecode evaluator, which each call
+        // of a function takes a window of
+        std::vector<form::Form> registers;
+        // the type conversions chaiscript calls its functions with
+        const chaiscript::Type_Conversions *conversions;
+        // how many calls of run are on the C++ stack, and where the first one is
+        std::size_t depth = 0;
+        std::uintptr_t stack_base = 0;
+        // the cells let* has made that may still be in use, which are looked
+        // through for ones only held by functions that hold each other
+        // whenever there are twice as many as were left the last time
+        std::vector<form::Form> cells;
+        std::size_t cells_kept = 0;
+
+        Runtime(chaiscript::ChaiScript *c);
+
+        form::Form make_cell();
+
+        Global & global(const Name *name);
+
+        void define(std::string_view name, form::Form value);
+
+        // the value of a global that zachlisp hasn't defined
+        form::Form lookup_host(Global & global);
+
+        form::Form eval(const form::Form & form);
+    };
+
+    bool is_symbol(const form::Form & form) {
+        return form.index() == form::TOKEN && form.token_type() == token::type::SYMBOL && token::value::is_text(form.value_type());
+    }
+
+    const Name * symbol_name(const form::Form & form) {
+        if (form.value_type() == token::value::SYMBOL) {
+            return form.token_symbol();
+        }
+        return token::value::intern(form.text()).name;
+    }
+
+    bool is_truthy(const form::Form & form) {
+        if (form.index() != form::TOKEN || form.token_type() != token::type::SYMBOL) {
+            return true;
+        }
+        switch (form.value_type()) {
+            case token::value::BOOL:
+                return form.token_bool();
+            case token::value::SYMBOL:
+                return form.token_symbol() != nil().token_symbol();
+            default:
+                break;
+        }
+        return true;
+    }
+
+    // what is known about the locals of a function while it's being analyzed
+    struct Scope {
+        // the names that have been bound, newest last
+        std::vector<std::pair<const Name *, std::size_t>> names;
+        // the names a let* is going to bind. functions made in the let* can
+        // refer to them before they are bound, as long as they aren't called
+        std::vector<std::pair<const Name *, std::size_t>> pending;
+        std::size_t frame_size = 0;
+        // the slots of the frame that hold cells
+        std::vector<bool> cells;
+        // where the values the function's closure captures come from
+        std::vector<Slot> captures;
+        // for a fn* bound by a let*, its name and the let*'s slot for it in
+        // the scope around, and its own slot for itself once it's used
+        const Name *self_name = nullptr;
+        std::size_t self_binding = 0;
+        std::optional<std::size_t> self;
+
+        bool is_cell(std::size_t index) const {
+            return index < cells.size() && cells[index];
+        }
+    };
+
+    class Analyzer {
+    public:
+        Analyzer(Runtime & r) : runtime(r) {
+            scopes.emplace_back();
+        }
+
+        ExprPtr analyze(const form::Form & form) {
+            switch (form.index()) {
+                case form::SPECIAL:
+                    throw form::get<form::Special>(form);
+                case form::TOKEN:
+                    if (is_symbol(form)) {
+                        return analyze_symbol(form);
+                    }
+                    return constant(form);
+                case form::LIST:
+                    return analyze_list(form);
+                case form::VECTOR:
+                    return analyze_items(VECTOR, form::get<form::Vector>(form));
+                case form::MAP:
+                    {
+                        auto expr = std::make_unique<Expr>(MAP);
+                        for (auto & item : form::get<form::FormWrapperMap>(form)) {
+                            expr->children.push_back(analyze(item.first.form));
+                            expr->children.push_back(analyze(item.second.form));
+                        }
+                        return expr;
+                    }
+                case form::SET:
+                    return analyze_items(SET, form::get<form::FormWrapperSet>(form));
+                default:
+                    break;
+            }
+            return constant(form);
+        }
+
+        // the size of the frame the top-level form needs
+        std::size_t frame_size() const {
+            return scopes.front().frame_size;
+        }
+
+    private:
+        Runtime & runtime;
+        std::vector<Scope> scopes;
+
+        static ExprPtr constant(form::Form value) {
+            auto expr = std::make_unique<Expr>(CONSTANT);
+            expr->value = std::move(value);
+            return expr;
+        }
+
+        template <class T>
+        ExprPtr analyze_items(Kind kind, const T & items) {
+            auto expr = std::make_unique<Expr>(kind);
+            for (auto & item : items) {
+                expr->children.push_back(analyze(item.form));
+            }
+            return expr;
+        }
+
+        ExprPtr analyze_symbol(const form::Form & form) {
+            auto name = symbol_name(form);
+            if (name == nil().token_symbol()) {
+                return constant(nil());
+            } else if (name->text.front() == ':') {
+                return constant(form);
+            }
+            // names that are bound are found before names that are pending.
+            // find skips the pending names of the frame the symbol is read in,
+            // since those aren't bound yet, so it goes on to outer scopes and globals
+            auto slot = find(scopes.size() - 1, name, false);
+            if (!slot) {
+                slot = find(scopes.size() - 1, name, true);
+            }
+            if (slot) {
+                auto expr = std::make_unique<Expr>(LOCAL);
+                expr->slot = *slot;
+                return expr;
+            }
+            auto expr = std::make_unique<Expr>(GLOBAL);
+            expr->global = &runtime.global(name);
+            return expr;
+        }
+
+        // where the function of scopes[i] finds a local, if it's one: in its
+        // frame, or in what its closure captures from the functions around
+        // it. a pending name found in one of those is made a cell, since
+        // the closure is made before the name is bound
+        std::optional<Slot> find(std::size_t i, const Name *name, bool pending) {
+            auto & scope = scopes[i];
+            for (auto it = scope.names.rbegin(); it != scope.names.rend(); ++it) {
+                if (it->first == name) {
+                    return Slot{0, it->second, scope.is_cell(it->second)};
+                }
+            }
+            if (pending && i + 1 < scopes.size()) {
+                for (auto it = scope.pending.rbegin(); it != scope.pending.rend(); ++it) {
+                    if (it->first == name) {
+                        scope.cells.resize(scope.frame_size, false);
+                        scope.cells[it->second] = true;
+                        return Slot{0, it->second, true};
                     }
                 }
+            }
+            if (i == 0) {
+                return std::nullopt;
+            }
+            if (pending && name == scope.self_name && refers_to_self(i)) {
+                if (!scope.self) {
+                    scope.self = scope.frame_size++;
+                }
+                return Slot{0, *scope.self, false};
+            }
+            auto outer = find(i - 1, name, pending);
+            if (!outer) {
+                return std::nullopt;
+            }
+            auto & captures = scope.captures;
+            auto it = std::find_if(captures.begin(), captures.end(), [&](auto & c) {
+                return c.depth == outer->depth && c.index == outer->index;
+            });
+            if (it == captures.end()) {
+                it = captures.insert(captures.end(), *outer);
+            }
+            return Slot{1, static_cast<std::size_t>(it - captures.begin()), outer->cell};
+        }
+
+        // whether the name of the fn* of scopes[i] would be found as the
+        // let* binding it's bound to, rather than something else of that name
+        bool refers_to_self(std::size_t i) const {
+            auto & outer = scopes[i - 1];
+            auto name = scopes[i].self_name;
+            for (auto & bound : outer.names) {
+                if (bound.first == name) {
+                    return false;
+                }
+            }
+            for (auto it = outer.pending.rbegin(); it != outer.pending.rend(); ++it) {
+                if (it->first == name) {
+                    return it->second == scopes[i].self_binding;
+                }
+            }
+            return false;
+        }
 
-                return chaiscript::Boxed_Value(new_vec);
+        // the forms of a body, which are evaluated like a do
+        ExprPtr analyze_body(const form::List & forms) {
+            if (forms.empty()) {
+                return constant(nil());
+            } else if (forms.size() == 1) {
+                return analyze(forms.front().form);
             }
-        case form::MAP:
-            {
-                auto map = *std::get<std::shared_ptr<form::FormWrapperMap>>(form);
-                auto new_map = std::map<std::string, chaiscript::Boxed_Value>();
-                auto new_map_it = new_map.begin();
-
-                for (auto it = map.begin(); it != map.end(); ++it) {
-                    auto key = form_to_chai((*it).first.form, chai);
-                    switch (key.index()) {
-                        case evaled::SPECIAL:
-                            return key;
+            return analyze_items(DO, forms);
+        }
+
+        ExprPtr analyze_list(const form::Form & form) {
+            static const Name *DEF = token::value::intern("def!").name;
+            static const Name *LET = token::value::intern("let*").name;
+            static const Name *FN = token::value::intern("fn*").name;
+            static const Name *DO_ = token::value::intern("do").name;
+            static const Name *IF_ = token::value::intern("if").name;
+            static const Name *QUOTE = token::value::intern("quote").name;
+
+            auto & list = form::get<form::List>(form);
+            if (list.empty()) {
+                return constant(form);
+            }
+            auto & first_form = list.front().form;
+            auto args = list.rest();
+
+            if (is_symbol(first_form)) {
+                auto name = symbol_name(first_form);
+                if (name == DEF) {
+                    return analyze_def(args);
+                } else if (name == LET) {
+                    return analyze_let(args);
+                } else if (name == FN) {
+                    return analyze_fn(args);
+                } else if (name == DO_) {
+                    return analyze_body(args);
+                } else if (name == IF_) {
+                    if (args.size() < 2 || args.size() > 3) {
+                        throw error("Invalid number of arguments function if");
                     }
-                    auto val = form_to_chai((*it).second.form, chai);
-                    switch (val.index()) {
-                        case evaled::SPECIAL:
-                            return key;
+                    return analyze_items(IF, args);
+                } else if (name == QUOTE) {
+                    if (args.size() != 1) {
+                        throw error("Invalid number of arguments function quote");
                     }
-                    auto new_key = std::get<chaiscript::Boxed_Value>(key);
-                    auto new_val = std::get<chaiscript::Boxed_Value>(val);
-                    auto stringified_key = pr_str(chai_to_form(new_key, chai));
-                    new_map.insert(new_map_it, std::pair(stringified_key, new_val));
+                    return constant(args.front().form);
                 }
+            }
 
-                return chaiscript::Boxed_Value(new_map);
+            auto expr = std::make_unique<Expr>(CALL);
+            expr->children.push_back(analyze(first_form));
+            for (auto & item : args) {
+                expr->children.push_back(analyze(item.form));
             }
-        case form::SET:
-            {
-                auto set = *std::get<std::shared_ptr<form::FormWrapperSet>>(form);
-                auto new_set = std::map<std::string, chaiscript::Boxed_Value>();
-                auto new_set_it = new_set.begin();
-
-                for (auto it = set.begin(); it != set.end(); ++it) {
-                    auto key = form_to_chai((*it).form, chai);
-                    switch (key.index()) {
-                        case evaled::SPECIAL:
-                            return key;
+            return expr;
+        }
+
+        ExprPtr analyze_def(const form::List & args) {
+            if (args.size() != 2 || !is_symbol(args.front().form)) {
+                throw error("def! takes a symbol and a value");
+            }
+            auto expr = std::make_unique<Expr>(DEF);
+            expr->global = &runtime.global(symbol_name(args.front().form));
+            expr->children.push_back(analyze(args.rest().front().form));
+            return expr;
+        }
+
+        // the symbols in a list or vector of bindings or parameters
+        static std::vector<const Name *> symbols(const form::Form & form, const std::string & fn_name) {
+            std::vector<const Name *> names;
+            auto add = [&](auto & items) {
+                for (auto & item : items) {
+                    if (!is_symbol(item.form)) {
+                        throw error(fn_name + " can only bind symbols");
                     }
-                    auto new_key = std::get<chaiscript::Boxed_Value>(key);
-                    auto stringified_key = pr_str(chai_to_form(new_key, chai));
-                    new_set.insert(new_set_it, std::pair(stringified_key, new_key));
+                    names.push_back(symbol_name(item.form));
                 }
+            };
+            switch (form.index()) {
+                case form::LIST:
+                    add(form::get<form::List>(form));
+                    break;
+                case form::VECTOR:
+                    add(form::get<form::Vector>(form));
+                    break;
+                default:
+                    throw error(fn_name + " needs a list or vector");
+            }
+            return names;
+        }
 
-                return chaiscript::Boxed_Value(new_set);
+        // the bindings of a let* get slots in the frame they're in
+        // rather than a frame of their own, so they cost nothing to make
+        ExprPtr analyze_let(const form::List & args) {
+            if (args.empty()) {
+                throw error("Invalid number of arguments function let*");
+            }
+            auto & bindings = args.front().form;
+            std::vector<const form::Form *> values;
+            switch (bindings.index()) {
+                case form::LIST:
+                    for (auto & item : form::get<form::List>(bindings)) {
+                        values.push_back(&item.form);
+                    }
+                    break;
+                case form::VECTOR:
+                    for (auto & item : form::get<form::Vector>(bindings)) {
+                        values.push_back(&item.form);
+                    }
+                    break;
+                default:
+                    throw error("let* needs a list or vector");
+            }
+            if (values.size() % 2) {
+                throw error("let* needs an even number of forms in its bindings");
             }
-    }
-    return form::Special{"RuntimeError", "Form not recognized", std::nullopt};
-}
 
-form::Form chai_to_form(chaiscript::Boxed_Value bv, chaiscript::ChaiScript* chai) {
-    if (bv.is_null()) {
-        return token::Token{std::string("nil"), token::type::SYMBOL, 0, 0};
-    }
+            // scopes can grow while the values are analyzed, so this is found again each time
+            auto depth = scopes.size() - 1;
+            auto names_size = scopes[depth].names.size();
+            auto pending_size = scopes[depth].pending.size();
+            for (std::size_t i = 0; i < values.size(); i += 2) {
+                if (!is_symbol(*values[i])) {
+                    throw error("let* can only bind symbols");
+                }
+                scopes[depth].pending.emplace_back(symbol_name(*values[i]), scopes[depth].frame_size++);
+            }
 
-    try {
-        auto vec = chai->boxed_cast<std::vector<chaiscript::Boxed_Value>>(bv);
-        auto new_vec = std::vector<form::FormWrapper>();
+            auto expr = std::make_unique<Expr>(LET);
+            for (std::size_t i = 0; i < values.size() / 2; ++i) {
+                auto & value = *values[i * 2 + 1];
+                if (is_fn(value)) {
+                    auto & binding = scopes[depth].pending[pending_size + i];
+                    expr->children.push_back(analyze_fn(form::get<form::List>(value).rest(), binding.first, binding.second));
+                } else {
+                    expr->children.push_back(analyze(value));
+                }
+                scopes[depth].names.push_back(scopes[depth].pending[pending_size + i]);
+            }
+            // which of the bindings are cells is only known once every value is analyzed
+            for (std::size_t i = 0; i < values.size() / 2; ++i) {
+                auto index = scopes[depth].pending[pending_size + i].second;
+                expr->slots.push_back(Slot{0, index, scopes[depth].is_cell(index)});
+            }
+            expr->children.push_back(analyze_body(args.rest()));
 
-        for (auto it = vec.begin(); it != vec.end(); ++it) {
-            new_vec.push_back(form::FormWrapper{chai_to_form(*it, chai)});
+            scopes[depth].names.resize(names_size);
+            scopes[depth].pending.resize(pending_size);
+            return expr;
         }
 
-        return new_vec;
-    } catch (const chaiscript::exception::bad_boxed_cast &) {}
+        static bool is_fn(const form::Form & form) {
+            static const Name *FN = token::value::intern("fn*").name;
+            if (form.index() != form::LIST || form::get<form::List>(form).empty()) {
+                return false;
+            }
+            auto & first = form::get<form::List>(form).front().form;
+            return is_symbol(first) && symbol_name(first) == FN;
+        }
 
-    try {
-        auto map = chai->boxed_cast<std::map<std::string, chaiscript::Boxed_Value>>(bv);
-        auto new_map = std::make_shared<form::FormWrapperMap>(form::FormWrapperMap{});
-        auto new_set = std::make_shared<form::FormWrapperSet>(form::FormWrapperSet{});
-        auto new_map_it = new_map->begin();
-        auto new_set_it = new_set->begin();
+        // self_name is the name a let* binds the function to, if it is
+        // bound by one, and self_binding the let*'s slot for it
+        ExprPtr analyze_fn(const form::List & args, const Name *self_name = nullptr, std::size_t self_binding = 0) {
+            static const Name *AMPERSAND = token::value::intern("&").name;
 
-        for (auto it = map.begin(); it != map.end(); ++it) {
-            auto key_str = (*it).first;
-            auto forms = read(key_str);
-            if (forms.size() != 1) {
-                return form::Special{"RuntimeError", "Failed to parse " + std::string(key_str), std::nullopt};
+            if (args.empty()) {
+                throw error("Invalid number of arguments function fn*");
             }
-            auto key = form::FormWrapper{forms.front()};
-            auto val = form::FormWrapper{chai_to_form((*it).second, chai)};
-            new_map->insert(new_map_it, std::pair(key, val));
-            if (key == val) {
-                new_set->insert(new_set_it, val);
+            auto names = symbols(args.front().form, "fn*");
+            auto lambda = std::make_shared<Lambda>();
+            lambda->variadic = false;
+            auto & scope = scopes.emplace_back();
+            scope.self_name = self_name;
+            scope.self_binding = self_binding;
+            for (auto it = names.begin(); it != names.end(); ++it) {
+                if (*it == AMPERSAND) {
+                    if (it + 2 != names.end()) {
+                        throw error("fn* needs one parameter after &");
+                    }
+                    lambda->variadic = true;
+                    continue;
+                }
+                scope.names.emplace_back(*it, scope.frame_size++);
             }
+            lambda->params = scope.frame_size - lambda->variadic;
+
+            lambda->body = analyze_body(args.rest());
+            lambda->frame_size = scopes.back().frame_size;
+            lambda->captures = std::move(scopes.back().captures);
+            lambda->self = scopes.back().self;
+            scopes.pop_back();
+
+            auto expr = std::make_unique<Expr>(LAMBDA);
+            expr->lambda = std::move(lambda);
+            return expr;
         }
+    };
 
-        if (new_map->size() == new_set->size()) {
-            return new_set;
-        } else {
-            return new_map;
+    chaiscript::Boxed_Value form_to_chai(const form::Form & form, chaiscript::ChaiScript* chai) {
+        switch (form.index()) {
+            case form::SPECIAL:
+                throw form::get<form::Special>(form);
+            case form::TOKEN:
+                switch (form.value_type()) {
+                    case token::value::BOOL:
+                        return chaiscript::const_var(form.token_bool());
+                    case token::value::LONG:
+                        return chaiscript::const_var(form.token_long());
+                    case token::value::DOUBLE:
+                        return chaiscript::const_var(form.token_double());
+                    case token::value::SYMBOL:
+                        if (form.token_symbol() == nil().token_symbol()) {
+                            return chaiscript::Boxed_Value();
+                        }
+                        break;
+                    default:
+                        break;
+                }
+                return eval_token(form.token());
+            case form::LIST:
+                {
+                    auto & list = form::get<form::List>(form);
+                    std::vector<chaiscript::Boxed_Value> vec;
+                    vec.reserve(list.size());
+                    for (auto & item : list) {
+                        vec.push_back(form_to_chai(item.form, chai));
+                    }
+                    return chaiscript::Boxed_Value(std::move(vec));
+                }
+            case form::VECTOR:
+                return chaiscript::Boxed_Value(shared::Vector{form});
+            case form::MAP:
+                return chaiscript::Boxed_Value(shared::Map{form});
+            case form::SET:
+                return chaiscript::Boxed_Value(shared::Set{form});
+            case form::FN:
+                {
+                    auto & fn = function(form);
+                    if (fn.kind == Function::HOST) {
+                        return static_cast<const HostFn &>(fn).fn;
+                    }
+                    throw error("Only chaiscript functions can be passed to chaiscript");
+                }
         }
-    } catch (const chaiscript::exception::bad_boxed_cast &) {}
+        throw error("Form not recognized");
+    }
 
-    try {
-        return token::Token{chai->boxed_cast<bool>(bv), token::type::SYMBOL, 0, 0};
-    } catch (const chaiscript::exception::bad_boxed_cast &) {}
+    // what chaiscript can do with the collections zachlisp hands it.
+    // items are converted when they're looked up, not all at once
+    void add_shared(chaiscript::ChaiScript* chai) {
+        using Range = shared::VectorRange;
+        auto items = [](const form::Form & vec) -> const form::Vector & {
+            return form::get<form::Vector>(vec);
+        };
 
-    try {
-        return token::Token{chai->boxed_cast<char>(bv), token::type::STRING, 0, 0};
-    } catch (const chaiscript::exception::bad_boxed_cast &) {}
+        chai->add(chaiscript::user_type<shared::Vector>(), "PersistentVector");
+        chai->add(chaiscript::constructor<shared::Vector (const shared::Vector &)>(), "PersistentVector");
+        // the prelude's algorithms build what they return with new and
+        // push_back, so they build one of chaiscript's own vectors
+        chai->add(chaiscript::fun([](const shared::Vector &) { return std::vector<chaiscript::Boxed_Value>(); }), "new");
+        chai->add(chaiscript::fun([items](const shared::Vector & vec) { return items(vec.form).size(); }), "size");
+        chai->add(chaiscript::fun([items](const shared::Vector & vec) { return items(vec.form).empty(); }), "empty");
+        // an index of exactly the type given is found before the conversion
+        // to chaiscript's vector, which would copy it, so there is one for
+        // chaiscript's ints, zachlisp's longs and sizes
+        auto at = [items, chai](const shared::Vector & vec, long index) {
+            auto & v = items(vec.form);
+            if (index < 0 || static_cast<std::size_t>(index) >= v.size()) {
+                throw std::out_of_range("Index out of range");
+            }
+            return form_to_chai(v[index].form, chai);
+        };
+        chai->add(chaiscript::fun(at), "[]");
+        chai->add(chaiscript::fun([at](const shared::Vector & vec, int index) { return at(vec, index); }), "[]");
+        chai->add(chaiscript::fun([at](const shared::Vector & vec, std::size_t index) { return at(vec, static_cast<long>(index)); }), "[]");
+        chai->add(chaiscript::fun([](const shared::Vector & vec) { return pr_str(vec.form); }), "to_string");
+        // for functions that want chaiscript's own vectors
+        chai->add(chaiscript::type_conversion<shared::Vector, std::vector<chaiscript::Boxed_Value>>([items, chai](const shared::Vector & vec) {
+            std::vector<chaiscript::Boxed_Value> ret;
+            ret.reserve(items(vec.form).size());
+            for (auto & item : items(vec.form)) {
+                ret.push_back(form_to_chai(item.form, chai));
+            }
+            return ret;
+        }));
 
-    try {
-        if (chaiscript::Boxed_Number::is_floating_point(bv)) {
-            return token::Token{chai->boxed_cast<double>(bv), token::type::NUMBER, 0, 0};
-        } else {
-            try {
-                return token::Token{chai->boxed_cast<long>(bv), token::type::NUMBER, 0, 0};
-            } catch (const chaiscript::exception::bad_boxed_cast &) {
-                return token::Token{(long)chai->boxed_cast<int>(bv), token::type::NUMBER, 0, 0};
+        chai->add(chaiscript::user_type<Range>(), "PersistentVector_Range");
+        chai->add(chaiscript::constructor<Range (const Range &)>(), "PersistentVector_Range");
+        chai->add(chaiscript::fun([items](const shared::Vector & vec) { return Range{vec.form, 0, items(vec.form).size()}; }), "range");
+        chai->add(chaiscript::fun([](const Range & range) { return range.begin == range.end; }), "empty");
+        chai->add(chaiscript::fun([items, chai](const Range & range) {
+            if (range.begin == range.end) {
+                throw std::range_error("Range empty");
+            }
+            return form_to_chai(items(range.form)[range.begin].form, chai);
+        }), "front");
+        chai->add(chaiscript::fun([items, chai](const Range & range) {
+            if (range.begin == range.end) {
+                throw std::range_error("Range empty");
+            }
+            return form_to_chai(items(range.form)[range.end - 1].form, chai);
+        }), "back");
+        chai->add(chaiscript::fun([](Range & range) {
+            if (range.begin == range.end) {
+                throw std::range_error("Range empty");
+            }
+            ++range.begin;
+        }), "pop_front");
+        chai->add(chaiscript::fun([](Range & range) {
+            if (range.begin == range.end) {
+                throw std::range_error("Range empty");
+            }
+            --range.end;
+        }), "pop_back");
+
+        auto find = [chai](const form::Form & coll, const chaiscript::Boxed_Value & key) -> const form::Form * {
+            auto wrapper = form::FormWrapper{chai_to_form(key, chai)};
+            if (coll.index() == form::MAP) {
+                auto value = form::get<form::FormWrapperMap>(coll).find(wrapper);
+                return value ? &value->form : nullptr;
+            }
+            auto item = form::get<form::FormWrapperSet>(coll).find(wrapper);
+            return item ? &item->form : nullptr;
+        };
+
+        chai->add(chaiscript::user_type<shared::Map>(), "HashMap");
+        chai->add(chaiscript::constructor<shared::Map (const shared::Map &)>(), "HashMap");
+        chai->add(chaiscript::fun([](const shared::Map & map) { return form::get<form::FormWrapperMap>(map.form).size(); }), "size");
+        chai->add(chaiscript::fun([](const shared::Map & map) { return form::get<form::FormWrapperMap>(map.form).empty(); }), "empty");
+        chai->add(chaiscript::fun([find](const shared::Map & map, const chaiscript::Boxed_Value & key) {
+            return find(map.form, key) ? std::size_t(1) : std::size_t(0);
+        }), "count");
+        chai->add(chaiscript::fun([find, chai](const shared::Map & map, const chaiscript::Boxed_Value & key) {
+            auto value = find(map.form, key);
+            return value ? form_to_chai(*value, chai) : chaiscript::Boxed_Value();
+        }), "[]");
+        chai->add(chaiscript::fun([](const shared::Map & map) { return pr_str(map.form); }), "to_string");
+
+        chai->add(chaiscript::user_type<shared::Set>(), "HashSet");
+        chai->add(chaiscript::constructor<shared::Set (const shared::Set &)>(), "HashSet");
+        chai->add(chaiscript::fun([](const shared::Set & set) { return form::get<form::FormWrapperSet>(set.form).size(); }), "size");
+        chai->add(chaiscript::fun([](const shared::Set & set) { return form::get<form::FormWrapperSet>(set.form).empty(); }), "empty");
+        chai->add(chaiscript::fun([find](const shared::Set & set, const chaiscript::Boxed_Value & key) {
+            return find(set.form, key) ? std::size_t(1) : std::size_t(0);
+        }), "count");
+        chai->add(chaiscript::fun([](const shared::Set & set) { return pr_str(set.form); }), "to_string");
+    }
+
+    // calls the function the way chaiscript's own dispatch does,
+    // without going through a std::function of a fixed arity
+    form::Form call_host(const HostFn & host, const form::Form *args, std::size_t count, Runtime & runtime) {
+        std::vector<chaiscript::Boxed_Value> params;
+        params.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            params.push_back(form_to_chai(args[i], runtime.chai));
+        }
+        chaiscript::Type_Conversions_State state(*runtime.conversions, runtime.conversions->conversion_saves());
+        chaiscript::Boxed_Value ret;
+        try {
+            ret = (*host.proxy)(params, state);
+        } catch (const chaiscript::exception::arity_error &) {
+            throw error("Invalid number of arguments function " + host.name);
+        } catch (const chaiscript::exception::dispatch_error &) {
+            throw error("No overload of function " + host.name + " takes these arguments");
+        } catch (const chaiscript::Boxed_Value & bv) {
+            // what a script throws comes out boxed, like chaiscript's own errors
+            if (bv.get_type_info().bare_equal(chaiscript::user_type<chaiscript::exception::eval_error>())) {
+                throw error(chaiscript::boxed_cast<const chaiscript::exception::eval_error &>(bv).what());
             }
+            throw error(pr_str(chai_to_form(bv, runtime.chai), false));
         }
-    } catch (const chaiscript::exception::bad_boxed_cast &) {}
+        return chai_to_form(ret, runtime.chai);
+    }
 
-    try {
-        return token::Token{chai->boxed_cast<std::string>(bv), token::type::STRING, 0, 0};
-    } catch (const chaiscript::exception::bad_boxed_cast &) {}
+    // makes the frame for a call of a closure
+    EnvPtr bind(const Lambda & lambda, const form::Form & self, const EnvPtr & captured, form::Form *args, std::size_t count) {
+        if (count < lambda.params || (!lambda.variadic && count > lambda.params)) {
+            throw error("Wrong number of arguments: expected " + std::to_string(lambda.params) + ", got " + std::to_string(count));
+        }
+        auto env = std::make_shared<Env>();
+        env->slots.reserve(lambda.frame_size);
+        for (std::size_t i = 0; i < lambda.params; ++i) {
+            env->slots.push_back(std::move(args[i]));
+        }
+        if (lambda.variadic) {
+            form::List::Builder rest;
+            for (auto i = lambda.params; i < count; ++i) {
+                rest.push_back(form::FormWrapper{std::move(args[i])});
+            }
+            env->slots.push_back(rest.persistent());
+        }
+        env->slots.resize(lambda.frame_size, nil());
+        if (lambda.self) {
+            env->slots[*lambda.self] = self;
+        }
+        env->captured = captured;
+        return env;
+    }
 
-    try {
-        chai->boxed_cast<evaled::fn::Zero>(bv);
-        return form::Special{"Object", "function", std::nullopt};
-    } catch (const chaiscript::exception::bad_boxed_cast &) {}
+    // how much of the C++ stack run can use before it gives up rather
+    // than overflowing it, leaving the rest for whatever it calls
+    std::size_t stack_limit() {
+#if __has_include(<sys/resource.h>)
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+            return limit.rlim_cur / 4 * 3;
+        }
+#endif
+        // the smallest default stack of the platforms zachlisp runs on
+        return 512 * 1024;
+    }
 
-    try {
-        chai->boxed_cast<evaled::fn::One>(bv);
-        return form::Special{"Object", "function", std::nullopt};
-    } catch (const chaiscript::exception::bad_boxed_cast &) {}
+    const std::size_t STACK_LIMIT = stack_limit();
 
-    return form::Special{"RuntimeError", "Value not recognized", std::nullopt};
-}
+    // evaluates an expression in a frame. calls to closures, and the
+    // bodies of if, do and let*, are evaluated by going around the loop
+    // rather than recursing, so tail calls don't use up the stack
+    form::Form run(const Expr *expr, const EnvPtr & frame, Runtime & runtime) {
+        char here;
+        auto address = reinterpret_cast<std::uintptr_t>(&here);
+        if (runtime.depth == 0) {
+            runtime.stack_base = address;
+        } else if ((address < runtime.stack_base ? runtime.stack_base - address : address - runtime.stack_base) > STACK_LIMIT) {
+            throw error("Stack overflow");
+        }
+        struct Depth {
+            std::size_t & depth;
+            Depth(std::size_t & d) : depth(d) { ++depth; }
+            ~Depth() { --depth; }
+        } depth(runtime.depth);
 
-std::list<form::Form> eval(std::list<form::Form> forms, chaiscript::ChaiScript* chai) {
-    std::list<form::Form> new_forms;
-    for (auto form : forms) {
-        try {
-            auto evaled_form = form_to_chai(form, chai);
-            switch (evaled_form.index()) {
-                case evaled::SPECIAL:
+        const EnvPtr *env = &frame;
+        // the frame and function of the last closure called in tail position
+        EnvPtr tail_env;
+        std::shared_ptr<const Lambda> tail_lambda;
+        while (true) {
+            switch (expr->kind) {
+                case CONSTANT:
+                    return expr->value;
+                case LOCAL:
                     {
-                        new_forms.push_back(std::get<form::Special>(evaled_form));
-                        break;
+                        auto & value = (expr->slot.depth ? (*env)->captured : *env)->slots[expr->slot.index];
+                        return expr->slot.cell ? cell(value).value : value;
+                    }
+                case GLOBAL:
+                    if (expr->global->value) {
+                        return *expr->global->value;
+                    }
+                    return runtime.lookup_host(*expr->global);
+                case IF:
+                    if (is_truthy(run(expr->children[0].get(), *env, runtime))) {
+                        expr = expr->children[1].get();
+                    } else if (expr->children.size() == 3) {
+                        expr = expr->children[2].get();
+                    } else {
+                        return nil();
                     }
-                case evaled::CHAI:
+                    break;
+                case DO:
+                    for (std::size_t i = 0; i + 1 < expr->children.size(); ++i) {
+                        run(expr->children[i].get(), *env, runtime);
+                    }
+                    expr = expr->children.back().get();
+                    break;
+                case LET:
+                    for (auto & slot : expr->slots) {
+                        if (slot.cell) {
+                            (*env)->slots[slot.index] = runtime.make_cell();
+                        }
+                    }
+                    for (std::size_t i = 0; i < expr->slots.size(); ++i) {
+                        auto value = run(expr->children[i].get(), *env, runtime);
+                        auto & slot = (*env)->slots[expr->slots[i].index];
+                        if (expr->slots[i].cell) {
+                            cell(slot).value = std::move(value);
+                        } else {
+                            slot = std::move(value);
+                        }
+                    }
+                    expr = expr->children.back().get();
+                    break;
+                case LAMBDA:
                     {
-                        auto ret = chai_to_form(std::get<chaiscript::Boxed_Value>(evaled_form), chai);
-                        new_forms.push_back(ret);
-                        break;
+                        EnvPtr captured;
+                        if (!expr->lambda->captures.empty()) {
+                            captured = std::make_shared<Env>();
+                            captured->slots.reserve(expr->lambda->captures.size());
+                            for (auto & slot : expr->lambda->captures) {
+                                captured->slots.push_back((slot.depth ? (*env)->captured : *env)->slots[slot.index]);
+                            }
+                        }
+                        return form::Fn(std::make_unique<Closure>(expr->lambda, std::move(captured)));
+                    }
+                case DEF:
+                    {
+                        auto value = run(expr->children[0].get(), *env, runtime);
+                        expr->global->value = value;
+                        return value;
+                    }
+                case VECTOR:
+                    {
+                        auto vec = form::Vector().transient();
+                        for (auto & child : expr->children) {
+                            vec.push_back(form::FormWrapper{run(child.get(), *env, runtime)});
+                        }
+                        return vec.persistent();
+                    }
+                case MAP:
+                    {
+                        auto map = form::FormWrapperMap().transient();
+                        for (std::size_t i = 0; i + 1 < expr->children.size(); i += 2) {
+                            auto key = run(expr->children[i].get(), *env, runtime);
+                            map.insert(form::FormWrapper{std::move(key)}, form::FormWrapper{run(expr->children[i + 1].get(), *env, runtime)});
+                        }
+                        return map.persistent();
+                    }
+                case SET:
+                    {
+                        auto set = form::FormWrapperSet().transient();
+                        for (auto & child : expr->children) {
+                            set.insert(form::FormWrapper{run(child.get(), *env, runtime)});
+                        }
+                        return set.persistent();
+                    }
+                case CALL:
+                    {
+                        auto fn = run(expr->children[0].get(), *env, runtime);
+                        if (fn.index() != form::FN) {
+                            throw error(pr_str(fn) + " is not a function");
+                        }
+                        auto & stack = runtime.stack;
+                        auto base = stack.size();
+                        for (std::size_t i = 1; i < expr->children.size(); ++i) {
+                            stack.push_back(run(expr->children[i].get(), *env, runtime));
+                        }
+                        auto args = stack.data() + base;
+                        auto count = stack.size() - base;
+
+                        auto & function = native::function(fn);
+                        if (function.kind != Function::CLOSURE) {
+                            auto ret = function.call(fn, args, count, runtime);
+                            stack.erase(stack.begin() + base, stack.end());
+                            return ret;
+                        }
+                        auto & closure = static_cast<const Closure &>(function);
+                        auto new_env = native::bind(*closure.lambda, fn, closure.env, args, count);
+                        stack.erase(stack.begin() + base, stack.end());
+
+                        tail_lambda = closure.lambda;
+                        tail_env = std::move(new_env);
+                        env = &tail_env;
+                        expr = tail_lambda->body.get();
+                    }
+                    break;
+            }
+        }
+    }
+
+    form::Form Closure::call(const form::Form & self, form::Form *args, std::size_t count, Runtime & runtime) const {
+        return run(lambda->body.get(), native::bind(*lambda, self, env, args, count), runtime);
+    }
+
+    form::Form HostFn::call(const form::Form &, form::Form *args, std::size_t count, Runtime & runtime) const {
+        return call_host(*this, args, count, runtime);
+    }
+
+    bool is_number(const form::Form & form) {
+        return form.index() == form::TOKEN && (form.value_type() == token::value::LONG || form.value_type() == token::value::DOUBLE);
+    }
+
+    double to_double(const form::Form & form) {
+        return form.value_type() == token::value::LONG ? form.token_long() : form.token_double();
+    }
+
+    // longs stay longs, and anything with a double in it becomes a double.
+    // one argument is applied to identity, so (- x) negates and (/ x) is 1/x
+    template <class Op>
+    form::Form arithmetic(const char *name, const form::Form *args, std::size_t count, long identity, Op op) {
+        if (count == 0) {
+            throw error(std::string("Invalid number of arguments function ") + name);
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            if (!is_number(args[i])) {
+                throw error(std::string(name) + " can't be used on " + pr_str(args[i]));
+            }
+        }
+        form::Form ret = count == 1 ? form::Form(token::Token{identity, token::type::NUMBER, 0, 0}) : args[0];
+        for (std::size_t i = count == 1 ? 0 : 1; i < count; ++i) {
+            auto & arg = args[i];
+            if (ret.value_type() == token::value::LONG && arg.value_type() == token::value::LONG) {
+                ret = token::Token{op(ret.token_long(), arg.token_long()), token::type::NUMBER, 0, 0};
+            } else {
+                ret = token::Token{op(to_double(ret), to_double(arg)), token::type::NUMBER, 0, 0};
+            }
+        }
+        return ret;
+    }
+
+    template <class Op>
+    form::Form compare(const char *name, const form::Form *args, std::size_t count, Op op) {
+        if (count == 0) {
+            throw error(std::string("Invalid number of arguments function ") + name);
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            if (!is_number(args[i])) {
+                throw error(std::string(name) + " can't be used on " + pr_str(args[i]));
+            }
+        }
+        for (std::size_t i = 1; i < count; ++i) {
+            auto & a = args[i - 1];
+            auto & b = args[i];
+            bool ret;
+            if (a.value_type() == token::value::LONG && b.value_type() == token::value::LONG) {
+                ret = op(a.token_long(), b.token_long());
+            } else {
+                ret = op(to_double(a), to_double(b));
+            }
+            if (!ret) {
+                return token::Token{false, token::type::SYMBOL, 0, 0};
+            }
+        }
+        return token::Token{true, token::type::SYMBOL, 0, 0};
+    }
+
+    std::string join(const form::Form *args, std::size_t count, const char *separator, bool print_readably) {
+        std::string s;
+        for (std::size_t i = 0; i < count; ++i) {
+            if (i > 0) {
+                s += separator;
+            }
+            s += pr_str(args[i], print_readably);
+        }
+        return s;
+    }
+
+    std::size_t size(const form::Form & form) {
+        switch (form.index()) {
+            case form::LIST:
+                return form::get<form::List>(form).size();
+            case form::VECTOR:
+                return form::get<form::Vector>(form).size();
+            case form::MAP:
+                return form::get<form::FormWrapperMap>(form).size();
+            case form::SET:
+                return form::get<form::FormWrapperSet>(form).size();
+            case form::TOKEN:
+                if (form.token_type() == token::type::STRING) {
+                    return form.text().size();
+                } else if (is_symbol(form) && symbol_name(form) == nil().token_symbol()) {
+                    return 0;
+                }
+                break;
+            default:
+                break;
+        }
+        throw error("count can't be used on " + pr_str(form));
+    }
+
+    // the items of a list, vector or nil as a list
+    form::List items(const form::Form & form) {
+        switch (form.index()) {
+            case form::LIST:
+                return form::get<form::List>(form);
+            case form::VECTOR:
+                {
+                    form::List::Builder list;
+                    for (auto & item : form::get<form::Vector>(form)) {
+                        list.push_back(item);
+                    }
+                    return list.persistent();
+                }
+            case form::TOKEN:
+                if (is_symbol(form) && symbol_name(form) == nil().token_symbol()) {
+                    return form::List();
+                }
+                break;
+            default:
+                break;
+        }
+        throw error("Can't make a list of " + pr_str(form));
+    }
+
+    void check_count(const char *name, std::size_t count, std::size_t expected) {
+        if (count != expected) {
+            throw error(std::string("Invalid number of arguments function ") + name);
+        }
+    }
+
+    const std::vector<std::pair<std::string_view, Builtin>> BUILTINS = {
+        {"+", [](const form::Form *args, std::size_t count) {
+            return arithmetic("+", args, count, 0, [](auto a, auto b) { return a + b; });
+        }},
+        {"-", [](const form::Form *args, std::size_t count) {
+            return arithmetic("-", args, count, 0, [](auto a, auto b) { return a - b; });
+        }},
+        {"*", [](const form::Form *args, std::size_t count) {
+            return arithmetic("*", args, count, 1, [](auto a, auto b) { return a * b; });
+        }},
+        {"/", [](const form::Form *args, std::size_t count) {
+            return arithmetic("/", args, count, 1, [](auto a, auto b) {
+                if constexpr (std::is_integral_v<decltype(b)>) {
+                    if (b == 0) {
+                        throw error("Division by zero");
                     }
+                }
+                return a / b;
+            });
+        }},
+        {"<", [](const form::Form *args, std::size_t count) {
+            return compare("<", args, count, [](auto a, auto b) { return a < b; });
+        }},
+        {"<=", [](const form::Form *args, std::size_t count) {
+            return compare("<=", args, count, [](auto a, auto b) { return a <= b; });
+        }},
+        {">", [](const form::Form *args, std::size_t count) {
+            return compare(">", args, count, [](auto a, auto b) { return a > b; });
+        }},
+        {">=", [](const form::Form *args, std::size_t count) {
+            return compare(">=", args, count, [](auto a, auto b) { return a >= b; });
+        }},
+        {"=", [](const form::Form *args, std::size_t count) {
+            for (std::size_t i = 1; i < count; ++i) {
+                if (!form::equals(form::FormWrapper{args[i - 1]}, form::FormWrapper{args[i]})) {
+                    return form::Form(token::Token{false, token::type::SYMBOL, 0, 0});
+                }
+            }
+            return form::Form(token::Token{true, token::type::SYMBOL, 0, 0});
+        }},
+        {"list", [](const form::Form *args, std::size_t count) {
+            form::List::Builder list;
+            for (std::size_t i = 0; i < count; ++i) {
+                list.push_back(form::FormWrapper{args[i]});
+            }
+            return form::Form(list.persistent());
+        }},
+        {"cons", [](const form::Form *args, std::size_t count) {
+            check_count("cons", count, 2);
+            return form::Form(items(args[1]).cons(form::FormWrapper{args[0]}));
+        }},
+        {"first", [](const form::Form *args, std::size_t count) {
+            check_count("first", count, 1);
+            auto list = items(args[0]);
+            return list.empty() ? nil() : list.front().form;
+        }},
+        {"rest", [](const form::Form *args, std::size_t count) {
+            check_count("rest", count, 1);
+            return form::Form(items(args[0]).rest());
+        }},
+        {"list?", [](const form::Form *args, std::size_t count) {
+            check_count("list?", count, 1);
+            return form::Form(token::Token{args[0].index() == form::LIST, token::type::SYMBOL, 0, 0});
+        }},
+        {"empty?", [](const form::Form *args, std::size_t count) {
+            check_count("empty?", count, 1);
+            return form::Form(token::Token{size(args[0]) == 0, token::type::SYMBOL, 0, 0});
+        }},
+        {"count", [](const form::Form *args, std::size_t count) {
+            check_count("count", count, 1);
+            return form::Form(token::Token{static_cast<long>(size(args[0])), token::type::NUMBER, 0, 0});
+        }},
+        {"not", [](const form::Form *args, std::size_t count) {
+            check_count("not", count, 1);
+            return form::Form(token::Token{!is_truthy(args[0]), token::type::SYMBOL, 0, 0});
+        }},
+        {"pr-str", [](const form::Form *args, std::size_t count) {
+            return form::Form(token::Token{join(args, count, " ", true), token::type::STRING, 0, 0});
+        }},
+        {"str", [](const form::Form *args, std::size_t count) {
+            return form::Form(token::Token{join(args, count, "", false), token::type::STRING, 0, 0});
+        }},
+        {"prn", [](const form::Form *args, std::size_t count) {
+            std::cout << join(args, count, " ", true) << "\n";
+            return nil();
+        }},
+        {"println", [](const form::Form *args, std::size_t count) {
+            std::cout << join(args, count, " ", false) << "\n";
+            return nil();
+        }},
+    };
+
+    // chaiscript only hands its type conversions to the functions it calls,
+    // so this is called through chaiscript once to find out what they are
+    class ConversionsProbe final : public chaiscript::dispatch::Proxy_Function_Base {
+    public:
+        mutable const chaiscript::Type_Conversions *conversions = nullptr;
+
+        ConversionsProbe() : Proxy_Function_Base({chaiscript::user_type<void>()}, 0) {}
+
+        bool operator==(const Proxy_Function_Base & f) const override {
+            return &f == this;
+        }
+
+        bool call_match(const std::vector<chaiscript::Boxed_Value> & vals, const chaiscript::Type_Conversions_State &) const override {
+            return vals.empty();
+        }
+
+    protected:
+        chaiscript::Boxed_Value do_call(const std::vector<chaiscript::Boxed_Value> &, const chaiscript::Type_Conversions_State & state) const override {
+            conversions = state.operator->();
+            return chaiscript::Boxed_Value();
+        }
+    };
+
+    Runtime::Runtime(chaiscript::ChaiScript *c) : chai(c) {
+        auto probe = std::make_shared<ConversionsProbe>();
+        chai->boxed_cast<std::function<void()>>(chaiscript::Boxed_Value(chaiscript::Const_Proxy_Function(probe)))();
+        conversions = probe->conversions;
+        add_shared(chai);
+        for (auto & builtin : BUILTINS) {
+            define(builtin.first, form::Fn(std::make_unique<BuiltinFn>(std::string(builtin.first), builtin.second)));
+        }
+    }
+
+    form::Form Runtime::make_cell() {
+        if (cells.size() >= std::max<std::size_t>(1024, cells_kept * 2)) {
+            release_cells(cells);
+            // what's left that only this holds is no longer in use
+            cells.erase(std::remove_if(cells.begin(), cells.end(), [](auto & cell) {
+                return cell.object()->references.load() == 1;
+            }), cells.end());
+            cells_kept = cells.size();
+        }
+        return cells.emplace_back(native::make_cell());
+    }
+
+    Global & Runtime::global(const Name *name) {
+        auto & global = globals[name];
+        if (!global) {
+            global = std::make_unique<Global>(Global{name, std::nullopt});
+        }
+        return *global;
+    }
+
+    void Runtime::define(std::string_view name, form::Form value) {
+        global(token::value::intern(name).name).value = std::move(value);
+    }
+
+    form::Form Runtime::lookup_host(Global & global) {
+        auto & name = global.name->text;
+        if (is_chai_identifier(name)) {
+            chaiscript::Boxed_Value bv;
+            try {
+                bv = chai->eval(name);
+            } catch (const chaiscript::exception::eval_error &) {
+                throw error("'" + name + "' not found");
             }
+            // functions are kept, since chaiscript can only add overloads to them,
+            // but other values are looked up every time in case they change
+            if (bv.get_type_info().bare_equal(chaiscript::user_type<chaiscript::dispatch::Proxy_Function_Base>())) {
+                auto proxy = chai->boxed_cast<chaiscript::Const_Proxy_Function>(bv);
+                global.value = form::Fn(std::make_unique<HostFn>(name, std::move(bv), std::move(proxy)));
+                return *global.value;
+            }
+            return chai_to_form(bv, chai);
+        }
+        throw error("'" + name + "' not found");
+    }
+
+    form::Form Runtime::eval(const form::Form & form) {
+        Analyzer analyzer(*this);
+        auto expr = analyzer.analyze(form);
+        auto env = std::make_shared<Env>();
+        env->slots.resize(analyzer.frame_size(), nil());
+        return run(expr.get(), env, *this);
+    }
+
+    }
+
+// evaluates each form with eval_form, turning whatever it throws into errors
+template <class F>
+std::list<form::Form> eval_each(const std::list<form::Form> & forms, native::Runtime & runtime, F eval_form) {
+    std::list<form::Form> new_forms;
+    for (auto & form : forms) {
+        try {
+            new_forms.push_back(eval_form(form));
+        } catch (const form::Special &e) {
+            new_forms.push_back(e);
         } catch (const chaiscript::exception::eval_error &e) {
             new_forms.push_back(form::Special{"RuntimeError", e.what(), std::nullopt});
+        } catch (const chaiscript::exception::arithmetic_error &e) {
+            new_forms.push_back(form::Special{"RuntimeError", e.what(), std::nullopt});
         } catch (const chaiscript::exception::bad_boxed_cast &e) {
             new_forms.push_back(form::Special{"RuntimeError", e.what(), std::nullopt});
         } catch (const chaiscript::detail::exception::bad_any_cast &e) {
             new_forms.push_back(form::Special{"RuntimeError", e.what(), std::nullopt});
+        } catch (const std::out_of_range &e) {
+            // what chaiscript's containers throw, and a script can catch
+            new_forms.push_back(form::Special{"RuntimeError", e.what(), std::nullopt});
+        } catch (const std::range_error &e) {
+            new_forms.push_back(form::Special{"RuntimeError", e.what(), std::nullopt});
         }
+        // whatever was being passed when an error was thrown is left behind
+        runtime.stack.clear();
+        runtime.registers.clear();
     }
     return new_forms;
 }
 
+std::list<form::Form> eval(const std::list<form::Form> & forms, native::Runtime & runtime) {
+    return eval_each(forms, runtime, [&](const form::Form & form) {
+        return runtime.eval(form);
+    });
+}
+
 }
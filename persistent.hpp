@@ -0,0 +1,1110 @@
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+
+namespace zachlisp {
+
+    // zachlisp::persistent
+    namespace persistent {
+
+    using Resource = std::pmr::memory_resource;
+
+    // every transient gets its own edit number, and the nodes it makes
+    // are stamped with it so only that transient changes them in place.
+    // numbers are never reused, and zero belongs to no transient.
+    std::uint64_t next_edit() {
+        static std::atomic<std::uint64_t> edits{0};
+        return ++edits;
+    }
+
+    unsigned popcount(std::uint32_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcount(bits);
+#else
+        return std::bitset<32>(bits).count();
+#endif
+    }
+
+        // zachlisp::persistent::hamt
+        namespace hamt {
+
+        // each level of the trie uses 5 bits of the hash to pick one of 32 branches
+        const unsigned BITS = 5;
+        const std::uint32_t MASK = (1 << BITS) - 1;
+        const unsigned HASH_BITS = sizeof(std::size_t) * 8;
+
+        std::uint32_t bit_for(std::size_t hash, unsigned shift) {
+            return std::uint32_t(1) << ((hash >> shift) & MASK);
+        }
+
+        // where the branch for a bit is stored, counting the branches before it
+        std::size_t index_for(std::uint32_t bitmap, std::uint32_t bit) {
+            return popcount(bitmap & (bit - 1));
+        }
+
+        template <class Entry>
+        struct Slot {
+            std::size_t hash;
+            Entry entry;
+        };
+
+        // datamap has a bit set for each branch that holds an entry, and
+        // nodemap for each branch that holds a child node. once the hash
+        // is used up, a node holds the entries whose hashes collide one
+        // after another, and neither map is used.
+        template <class Entry>
+        struct Node {
+            std::uint32_t datamap = 0;
+            std::uint32_t nodemap = 0;
+            std::uint64_t edit;
+            std::pmr::vector<Slot<Entry>> slots;
+            std::pmr::vector<std::shared_ptr<Node>> children;
+
+            Node(std::uint64_t e, Resource *resource) : edit(e), slots(resource), children(resource) {}
+        };
+
+        // visits the entries of a node before the entries of its children,
+        // so the order only depends on what's in the trie
+        template <class Entry>
+        class Iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = Entry;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Entry *;
+            using reference = const Entry &;
+
+            Iterator() {}
+
+            explicit Iterator(const Node<Entry> *root) {
+                if (root) {
+                    push(root);
+                    settle();
+                }
+            }
+
+            reference operator*() const {
+                auto & frame = stack[depth - 1];
+                return frame.node->slots[frame.slot].entry;
+            }
+
+            pointer operator->() const {
+                return &**this;
+            }
+
+            Iterator & operator++() {
+                ++stack[depth - 1].slot;
+                settle();
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                auto ret = *this;
+                ++*this;
+                return ret;
+            }
+
+            bool operator==(const Iterator & it) const {
+                if (depth != it.depth) {
+                    return false;
+                }
+                return depth == 0 ||
+                    (stack[depth - 1].node == it.stack[depth - 1].node && stack[depth - 1].slot == it.stack[depth - 1].slot);
+            }
+
+            bool operator!=(const Iterator & it) const {
+                return !(*this == it);
+            }
+
+        private:
+            struct Frame {
+                const Node<Entry> *node;
+                std::size_t slot;
+                std::size_t child;
+            };
+
+            // a level for each 5 bits of the hash, and one for collisions
+            std::array<Frame, HASH_BITS / BITS + 2> stack;
+            std::size_t depth = 0;
+
+            void push(const Node<Entry> *node) {
+                stack[depth++] = Frame{node, 0, 0};
+            }
+
+            // stops at the next entry, going down into children
+            // and back up out of nodes that have been used up
+            void settle() {
+                while (depth > 0) {
+                    auto & frame = stack[depth - 1];
+                    if (frame.slot < frame.node->slots.size()) {
+                        return;
+                    } else if (frame.child < frame.node->children.size()) {
+                        auto child = frame.node->children[frame.child++].get();
+                        push(child);
+                    } else {
+                        --depth;
+                    }
+                }
+            }
+        };
+
+        // a hash array mapped trie, in the compressed form where a node keeps
+        // its entries apart from its children. updates copy the path from the
+        // root to the entry and share everything else, unless a transient owns
+        // the nodes on that path, in which case they are changed in place.
+        template <class Key, class Entry, class KeyOf, class Hash, class Equal>
+        class Trie {
+        public:
+            using iterator = Iterator<Entry>;
+            using const_iterator = Iterator<Entry>;
+
+            std::size_t size() const {
+                return items;
+            }
+
+            bool empty() const {
+                return items == 0;
+            }
+
+            iterator begin() const {
+                return iterator(root.get());
+            }
+
+            iterator end() const {
+                return iterator();
+            }
+
+            // whether both share the same root, and so hold the same entries
+            bool identical(const Trie & trie) const {
+                return root == trie.root;
+            }
+
+        protected:
+            using NodeType = Node<Entry>;
+            using Ptr = std::shared_ptr<NodeType>;
+
+            Ptr root;
+            std::size_t items = 0;
+
+            const Entry * lookup(const Key & key) const {
+                std::size_t hash = Hash()(key);
+                const NodeType *node = root.get();
+                unsigned shift = 0;
+                while (node) {
+                    if (shift >= HASH_BITS) {
+                        for (auto & slot : node->slots) {
+                            if (Equal()(KeyOf()(slot.entry), key)) {
+                                return &slot.entry;
+                            }
+                        }
+                        return nullptr;
+                    }
+                    auto bit = bit_for(hash, shift);
+                    if (node->datamap & bit) {
+                        auto & slot = node->slots[index_for(node->datamap, bit)];
+                        if (slot.hash == hash && Equal()(KeyOf()(slot.entry), key)) {
+                            return &slot.entry;
+                        }
+                        return nullptr;
+                    } else if (node->nodemap & bit) {
+                        node = node->children[index_for(node->nodemap, bit)].get();
+                        shift += BITS;
+                    } else {
+                        return nullptr;
+                    }
+                }
+                return nullptr;
+            }
+
+            // adds an entry, or replaces the one with the same key if asked to.
+            // returns whether the key wasn't there before
+            bool put(Entry entry, bool replace, std::uint64_t edit, Resource *resource) {
+                Slot<Entry> slot{Hash()(KeyOf()(entry)), std::move(entry)};
+                if (!root) {
+                    root = make(edit, resource);
+                    root->datamap = bit_for(slot.hash, 0);
+                    root->slots.push_back(std::move(slot));
+                    items = 1;
+                    return true;
+                }
+                bool added = false;
+                root = assoc(root, 0, slot, replace, added, edit, resource);
+                if (added) {
+                    ++items;
+                }
+                return added;
+            }
+
+            bool remove(const Key & key, std::uint64_t edit, Resource *resource) {
+                if (!root) {
+                    return false;
+                }
+                bool removed = false;
+                root = dissoc(root, 0, Hash()(key), key, removed, edit, resource);
+                if (removed && --items == 0) {
+                    root = nullptr;
+                }
+                return removed;
+            }
+
+        private:
+            static Ptr make(std::uint64_t edit, Resource *resource) {
+                return std::allocate_shared<NodeType>(std::pmr::polymorphic_allocator<NodeType>(resource), edit, resource);
+            }
+
+            // the node itself if the transient making the edit owns it, otherwise a copy it owns
+            static Ptr editable(const Ptr & node, std::uint64_t edit, Resource *resource) {
+                if (edit != 0 && node->edit == edit) {
+                    return node;
+                }
+                auto copy = make(edit, resource);
+                copy->datamap = node->datamap;
+                copy->nodemap = node->nodemap;
+                copy->slots.assign(node->slots.begin(), node->slots.end());
+                copy->children.assign(node->children.begin(), node->children.end());
+                return copy;
+            }
+
+            // a node holding two entries whose hashes match up to shift
+            static Ptr merge(unsigned shift, Slot<Entry> && slot1, Slot<Entry> && slot2, std::uint64_t edit, Resource *resource) {
+                auto node = make(edit, resource);
+                if (shift >= HASH_BITS) {
+                    node->slots.push_back(std::move(slot1));
+                    node->slots.push_back(std::move(slot2));
+                    return node;
+                }
+                auto bit1 = bit_for(slot1.hash, shift);
+                auto bit2 = bit_for(slot2.hash, shift);
+                if (bit1 == bit2) {
+                    node->nodemap = bit1;
+                    node->children.push_back(merge(shift + BITS, std::move(slot1), std::move(slot2), edit, resource));
+                } else {
+                    node->datamap = bit1 | bit2;
+                    if (bit1 > bit2) {
+                        std::swap(slot1, slot2);
+                    }
+                    node->slots.push_back(std::move(slot1));
+                    node->slots.push_back(std::move(slot2));
+                }
+                return node;
+            }
+
+            static Ptr assoc(const Ptr & node, unsigned shift, Slot<Entry> & slot, bool replace, bool & added, std::uint64_t edit, Resource *resource) {
+                const Key & key = KeyOf()(slot.entry);
+                if (shift >= HASH_BITS) {
+                    for (std::size_t i = 0; i < node->slots.size(); ++i) {
+                        if (Equal()(KeyOf()(node->slots[i].entry), key)) {
+                            if (!replace) {
+                                return node;
+                            }
+                            auto ret = editable(node, edit, resource);
+                            ret->slots[i] = std::move(slot);
+                            return ret;
+                        }
+                    }
+                    auto ret = editable(node, edit, resource);
+                    ret->slots.push_back(std::move(slot));
+                    added = true;
+                    return ret;
+                }
+
+                auto bit = bit_for(slot.hash, shift);
+                if (node->datamap & bit) {
+                    auto i = index_for(node->datamap, bit);
+                    auto & existing = node->slots[i];
+                    if (existing.hash == slot.hash && Equal()(KeyOf()(existing.entry), key)) {
+                        if (!replace) {
+                            return node;
+                        }
+                        auto ret = editable(node, edit, resource);
+                        ret->slots[i] = std::move(slot);
+                        return ret;
+                    }
+                    // two different keys want the same branch, so they go down a level
+                    auto ret = editable(node, edit, resource);
+                    auto child = merge(shift + BITS, std::move(ret->slots[i]), std::move(slot), edit, resource);
+                    ret->slots.erase(ret->slots.begin() + i);
+                    ret->datamap ^= bit;
+                    ret->nodemap |= bit;
+                    ret->children.insert(ret->children.begin() + index_for(ret->nodemap, bit), std::move(child));
+                    added = true;
+                    return ret;
+                } else if (node->nodemap & bit) {
+                    auto i = index_for(node->nodemap, bit);
+                    auto & child = node->children[i];
+                    auto new_child = assoc(child, shift + BITS, slot, replace, added, edit, resource);
+                    if (new_child == child) {
+                        return node;
+                    }
+                    auto ret = editable(node, edit, resource);
+                    ret->children[i] = std::move(new_child);
+                    return ret;
+                }
+                auto ret = editable(node, edit, resource);
+                ret->slots.insert(ret->slots.begin() + index_for(ret->datamap, bit), std::move(slot));
+                ret->datamap |= bit;
+                added = true;
+                return ret;
+            }
+
+            static Ptr dissoc(const Ptr & node, unsigned shift, std::size_t hash, const Key & key, bool & removed, std::uint64_t edit, Resource *resource) {
+                if (shift >= HASH_BITS) {
+                    for (std::size_t i = 0; i < node->slots.size(); ++i) {
+                        if (Equal()(KeyOf()(node->slots[i].entry), key)) {
+                            auto ret = editable(node, edit, resource);
+                            ret->slots.erase(ret->slots.begin() + i);
+                            removed = true;
+                            return ret;
+                        }
+                    }
+                    return node;
+                }
+
+                auto bit = bit_for(hash, shift);
+                if (node->datamap & bit) {
+                    auto i = index_for(node->datamap, bit);
+                    auto & existing = node->slots[i];
+                    if (existing.hash != hash || !Equal()(KeyOf()(existing.entry), key)) {
+                        return node;
+                    }
+                    auto ret = editable(node, edit, resource);
+                    ret->slots.erase(ret->slots.begin() + i);
+                    ret->datamap ^= bit;
+                    removed = true;
+                    return ret;
+                } else if (node->nodemap & bit) {
+                    auto i = index_for(node->nodemap, bit);
+                    auto new_child = dissoc(node->children[i], shift + BITS, hash, key, removed, edit, resource);
+                    if (!removed) {
+                        return node;
+                    }
+                    auto ret = editable(node, edit, resource);
+                    if (new_child->children.empty() && new_child->slots.size() == 1) {
+                        // a child left with one entry is folded back into this node,
+                        // so the same entries always make the same trie
+                        ret->children.erase(ret->children.begin() + i);
+                        ret->nodemap ^= bit;
+                        ret->slots.insert(ret->slots.begin() + index_for(ret->datamap, bit), new_child->slots.front());
+                        ret->datamap |= bit;
+                    } else {
+                        ret->children[i] = std::move(new_child);
+                    }
+                    return ret;
+                }
+                return node;
+            }
+        };
+
+        template <class Key, class Value>
+        struct First {
+            const Key & operator()(const std::pair<Key, Value> & entry) const {
+                return entry.first;
+            }
+        };
+
+        template <class Key>
+        struct Identity {
+            const Key & operator()(const Key & entry) const {
+                return entry;
+            }
+        };
+
+        }
+
+    // a persistent hash map. assoc and dissoc leave the map alone and
+    // return a new one sharing most of its nodes, in O(log32 n).
+    // new nodes come from the default resource, like copies of the
+    // standard pmr containers, and transients use the resource they're given.
+    template <class Key, class Value, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>>
+    class Map : public hamt::Trie<Key, std::pair<Key, Value>, hamt::First<Key, Value>, Hash, Equal> {
+    public:
+        using value_type = std::pair<Key, Value>;
+
+        // builds up a map in place, without copying nodes it made itself.
+        // after persistent is called, it copies nodes again like a map does.
+        class Transient {
+        public:
+            Transient(const Map & m, Resource *r) : map(m), edit(next_edit()), resource(r) {}
+
+            // two transients must never share an edit
+            Transient(const Transient &) = delete;
+            Transient(Transient &&) = default;
+
+            // adds the entry if the key isn't there yet, like std::unordered_map::insert
+            bool insert(Key key, Value value) {
+                return map.put(value_type(std::move(key), std::move(value)), false, edit, resource);
+            }
+
+            void assoc(Key key, Value value) {
+                map.put(value_type(std::move(key), std::move(value)), true, edit, resource);
+            }
+
+            void dissoc(const Key & key) {
+                map.remove(key, edit, resource);
+            }
+
+            std::size_t size() const {
+                return map.size();
+            }
+
+            Map persistent() {
+                edit = 0;
+                return map;
+            }
+
+        private:
+            Map map;
+            std::uint64_t edit;
+            Resource *resource;
+        };
+
+        // the value for a key, or null if it isn't in the map
+        const Value * find(const Key & key) const {
+            auto entry = this->lookup(key);
+            return entry ? &entry->second : nullptr;
+        }
+
+        std::size_t count(const Key & key) const {
+            return this->lookup(key) ? 1 : 0;
+        }
+
+        Map assoc(Key key, Value value) const {
+            Map ret = *this;
+            ret.put(value_type(std::move(key), std::move(value)), true, 0, std::pmr::get_default_resource());
+            return ret;
+        }
+
+        Map dissoc(const Key & key) const {
+            Map ret = *this;
+            ret.remove(key, 0, std::pmr::get_default_resource());
+            return ret;
+        }
+
+        Transient transient(Resource *resource = std::pmr::get_default_resource()) const {
+            return Transient(*this, resource);
+        }
+    };
+
+    // a persistent hash set, built the same way as Map
+    template <class Key, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>>
+    class Set : public hamt::Trie<Key, Key, hamt::Identity<Key>, Hash, Equal> {
+    public:
+        using value_type = Key;
+
+        class Transient {
+        public:
+            Transient(const Set & s, Resource *r) : set(s), edit(next_edit()), resource(r) {}
+
+            // two transients must never share an edit
+            Transient(const Transient &) = delete;
+            Transient(Transient &&) = default;
+
+            bool insert(Key key) {
+                return set.put(std::move(key), false, edit, resource);
+            }
+
+            void disj(const Key & key) {
+                set.remove(key, edit, resource);
+            }
+
+            std::size_t size() const {
+                return set.size();
+            }
+
+            Set persistent() {
+                edit = 0;
+                return set;
+            }
+
+        private:
+            Set set;
+            std::uint64_t edit;
+            Resource *resource;
+        };
+
+        // the item in the set equal to key, or null if there isn't one
+        const Key * find(const Key & key) const {
+            return this->lookup(key);
+        }
+
+        std::size_t count(const Key & key) const {
+            return this->lookup(key) ? 1 : 0;
+        }
+
+        Set conj(Key key) const {
+            Set ret = *this;
+            ret.put(std::move(key), false, 0, std::pmr::get_default_resource());
+            return ret;
+        }
+
+        Set disj(const Key & key) const {
+            Set ret = *this;
+            ret.remove(key, 0, std::pmr::get_default_resource());
+            return ret;
+        }
+
+        Transient transient(Resource *resource = std::pmr::get_default_resource()) const {
+            return Transient(*this, resource);
+        }
+    };
+
+
+        // zachlisp::persistent::trie
+        namespace trie {
+
+        const unsigned BITS = 5;
+        const std::size_t WIDTH = std::size_t(1) << BITS;
+        const std::size_t MASK = WIDTH - 1;
+
+        // a branch holds up to 32 children and a leaf up to 32 items
+        template <class T>
+        struct Node {
+            std::uint64_t edit;
+            std::pmr::vector<std::shared_ptr<Node>> children;
+            std::pmr::vector<T> items;
+
+            Node(std::uint64_t e, Resource *resource) : edit(e), children(resource), items(resource) {}
+        };
+
+        }
+
+    // a persistent vector, as a trie with 32 children per node and the last
+    // leaf kept apart as the tail. conj only touches the tail until it fills
+    // up, and assoc and pop copy one path, so all of them are O(log32 n)
+    // and share everything else. a slice keeps the trie it came from and
+    // an offset into it, so subvec is O(log32 n) as well.
+    template <class T>
+    class Vector {
+        using Node = trie::Node<T>;
+        using Ptr = std::shared_ptr<Node>;
+
+    public:
+        using value_type = T;
+
+        class Transient;
+
+        // visits the items a leaf at a time
+        class Iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const T *;
+            using reference = const T &;
+
+            Iterator() {}
+
+            Iterator(const Vector *v, std::size_t i) : vector(v), index(i) {
+                if (index < vector->count) {
+                    leaf = vector->leaf_for(index);
+                }
+            }
+
+            reference operator*() const {
+                return leaf->items[index & trie::MASK];
+            }
+
+            pointer operator->() const {
+                return &**this;
+            }
+
+            Iterator & operator++() {
+                ++index;
+                if ((index & trie::MASK) == 0 && index < vector->count) {
+                    leaf = vector->leaf_for(index);
+                }
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                auto ret = *this;
+                ++*this;
+                return ret;
+            }
+
+            bool operator==(const Iterator & it) const {
+                return index == it.index;
+            }
+
+            bool operator!=(const Iterator & it) const {
+                return !(*this == it);
+            }
+
+        private:
+            const Vector *vector = nullptr;
+            std::size_t index = 0;
+            const Node *leaf = nullptr;
+        };
+
+        using iterator = Iterator;
+        using const_iterator = Iterator;
+
+        Vector() = default;
+
+        std::size_t size() const {
+            return count - start;
+        }
+
+        bool empty() const {
+            return count == start;
+        }
+
+        iterator begin() const {
+            return iterator(this, start);
+        }
+
+        iterator end() const {
+            return iterator(this, count);
+        }
+
+        const T & operator[](std::size_t i) const {
+            auto index = start + i;
+            return leaf_for(index)->items[index & trie::MASK];
+        }
+
+        const T & front() const {
+            return (*this)[0];
+        }
+
+        const T & back() const {
+            return (*this)[size() - 1];
+        }
+
+        // whether both are the same slice of the same trie, and so hold the same items
+        bool identical(const Vector & v) const {
+            return root == v.root && tail == v.tail && start == v.start && count == v.count;
+        }
+
+        Vector conj(T item) const {
+            Vector ret = *this;
+            ret.push(std::move(item), 0, std::pmr::get_default_resource());
+            return ret;
+        }
+
+        Vector assoc(std::size_t i, T item) const {
+            Vector ret = *this;
+            ret.replace(start + i, std::move(item), 0, std::pmr::get_default_resource());
+            return ret;
+        }
+
+        // everything but the last item
+        Vector pop() const {
+            Vector ret = *this;
+            ret.truncate(count - 1, 0, std::pmr::get_default_resource());
+            return ret;
+        }
+
+        // the items from index from up to but not including index to
+        Vector slice(std::size_t from, std::size_t to) const {
+            if (from == to) {
+                return Vector();
+            }
+            Vector ret = *this;
+            ret.truncate(start + to, 0, std::pmr::get_default_resource());
+            ret.start += from;
+            return ret;
+        }
+
+        // adds the items of another vector onto the end of this one,
+        // copying only the leaves the new items go into
+        Vector concat(const Vector & v) const {
+            if (empty()) {
+                return v;
+            }
+            auto ret = transient();
+            for (auto & item : v) {
+                ret.push_back(item);
+            }
+            return ret.persistent();
+        }
+
+        Transient transient(Resource *resource = std::pmr::get_default_resource()) const {
+            return Transient(*this, resource);
+        }
+
+        // builds up a vector in place, without copying nodes it made itself
+        class Transient {
+        public:
+            Transient(const Vector & v, Resource *r) : vector(v), edit(next_edit()), resource(r) {}
+
+            // two transients must never share an edit
+            Transient(const Transient &) = delete;
+            Transient(Transient &&) = default;
+
+            void push_back(T item) {
+                vector.push(std::move(item), edit, resource);
+            }
+
+            void assoc(std::size_t i, T item) {
+                vector.replace(vector.start + i, std::move(item), edit, resource);
+            }
+
+            void pop_back() {
+                vector.truncate(vector.count - 1, edit, resource);
+            }
+
+            std::size_t size() const {
+                return vector.size();
+            }
+
+            Vector persistent() {
+                edit = 0;
+                return vector;
+            }
+
+        private:
+            Vector vector;
+            std::uint64_t edit;
+            Resource *resource;
+        };
+
+    private:
+        // the trie holds every item before the tail. root is null until it holds any
+        Ptr root;
+        Ptr tail;
+        unsigned shift = trie::BITS;
+        // the number of items in the trie and tail, including any a slice skips
+        std::size_t count = 0;
+        std::size_t start = 0;
+
+        static Ptr make(std::uint64_t edit, Resource *resource) {
+            return std::allocate_shared<Node>(std::pmr::polymorphic_allocator<Node>(resource), edit, resource);
+        }
+
+        static Ptr editable(const Ptr & node, std::uint64_t edit, Resource *resource) {
+            if (edit != 0 && node->edit == edit) {
+                return node;
+            }
+            auto copy = make(edit, resource);
+            copy->children.assign(node->children.begin(), node->children.end());
+            if (!node->items.empty()) {
+                // with room for one more, since a copied tail is usually conj'd onto
+                copy->items.reserve(std::min(node->items.size() + 1, trie::WIDTH));
+                copy->items.assign(node->items.begin(), node->items.end());
+            }
+            return copy;
+        }
+
+        // the index of the first item in the tail
+        std::size_t tail_offset() const {
+            return count < trie::WIDTH ? 0 : ((count - 1) >> trie::BITS) << trie::BITS;
+        }
+
+        const Node * leaf_for(std::size_t index) const {
+            if (index >= tail_offset()) {
+                return tail.get();
+            }
+            const Node *node = root.get();
+            for (unsigned level = shift; level > 0; level -= trie::BITS) {
+                node = node->children[(index >> level) & trie::MASK].get();
+            }
+            return node;
+        }
+
+        // a chain of branches down to a leaf
+        static Ptr new_path(unsigned level, Ptr node, std::uint64_t edit, Resource *resource) {
+            if (level == 0) {
+                return node;
+            }
+            auto ret = make(edit, resource);
+            ret->children.push_back(new_path(level - trie::BITS, std::move(node), edit, resource));
+            return ret;
+        }
+
+        Ptr push_tail(unsigned level, const Ptr & parent, Ptr leaf, std::uint64_t edit, Resource *resource) const {
+            auto ret = editable(parent, edit, resource);
+            auto i = ((count - 1) >> level) & trie::MASK;
+            if (level == trie::BITS) {
+                ret->children.push_back(std::move(leaf));
+            } else if (i < ret->children.size()) {
+                ret->children[i] = push_tail(level - trie::BITS, ret->children[i], std::move(leaf), edit, resource);
+            } else {
+                ret->children.push_back(new_path(level - trie::BITS, std::move(leaf), edit, resource));
+            }
+            return ret;
+        }
+
+        void push(T item, std::uint64_t edit, Resource *resource) {
+            if (!tail) {
+                tail = make(edit, resource);
+            }
+            if (count - tail_offset() < trie::WIDTH) {
+                if (edit == 0 || tail->edit != edit) {
+                    tail = editable(tail, edit, resource);
+                }
+                tail->items.push_back(std::move(item));
+                ++count;
+                return;
+            }
+            // the tail is full, so it goes into the trie and a new one is started
+            if (!root) {
+                root = make(edit, resource);
+                root->children.push_back(std::move(tail));
+            } else if ((count >> trie::BITS) > (std::size_t(1) << shift)) {
+                auto new_root = make(edit, resource);
+                new_root->children.push_back(root);
+                new_root->children.push_back(new_path(shift, std::move(tail), edit, resource));
+                root = std::move(new_root);
+                shift += trie::BITS;
+            } else {
+                root = push_tail(shift, root, std::move(tail), edit, resource);
+            }
+            // a vector this long will probably fill the next tail too
+            tail = make(edit, resource);
+            tail->items.reserve(trie::WIDTH);
+            tail->items.push_back(std::move(item));
+            ++count;
+        }
+
+        static Ptr replace_in(unsigned level, const Ptr & node, std::size_t index, T && item, std::uint64_t edit, Resource *resource) {
+            auto ret = editable(node, edit, resource);
+            if (level == 0) {
+                ret->items[index & trie::MASK] = std::move(item);
+            } else {
+                auto i = (index >> level) & trie::MASK;
+                ret->children[i] = replace_in(level - trie::BITS, ret->children[i], index, std::move(item), edit, resource);
+            }
+            return ret;
+        }
+
+        void replace(std::size_t index, T item, std::uint64_t edit, Resource *resource) {
+            if (index >= tail_offset()) {
+                tail = editable(tail, edit, resource);
+                tail->items[index & trie::MASK] = std::move(item);
+            } else {
+                root = replace_in(shift, root, index, std::move(item), edit, resource);
+            }
+        }
+
+        // keeps the first limit items under a branch, where limit is a whole number of leaves
+        static Ptr trim(unsigned level, const Ptr & node, std::size_t limit, std::uint64_t edit, Resource *resource) {
+            auto ret = editable(node, edit, resource);
+            std::size_t span = std::size_t(1) << level;
+            std::size_t keep = (limit + span - 1) >> level;
+            ret->children.erase(ret->children.begin() + keep, ret->children.end());
+            std::size_t rest = limit - ((keep - 1) << level);
+            if (level > trie::BITS && rest < span) {
+                ret->children[keep - 1] = trim(level - trie::BITS, ret->children[keep - 1], rest, edit, resource);
+            }
+            return ret;
+        }
+
+        // drops every item from new_count on
+        void truncate(std::size_t new_count, std::uint64_t edit, Resource *resource) {
+            if (new_count >= count) {
+                return;
+            } else if (new_count <= start) {
+                *this = Vector();
+                return;
+            }
+            auto old_tail_offset = tail_offset();
+            if (new_count > old_tail_offset) {
+                tail = editable(tail, edit, resource);
+                tail->items.erase(tail->items.begin() + (new_count - old_tail_offset), tail->items.end());
+                count = new_count;
+                return;
+            }
+            // the leaf holding the new last item becomes the tail
+            auto new_tail_offset = ((new_count - 1) >> trie::BITS) << trie::BITS;
+            auto leaf = leaf_for(new_count - 1);
+            auto new_tail = make(edit, resource);
+            new_tail->items.assign(leaf->items.begin(), leaf->items.begin() + (new_count - new_tail_offset));
+            tail = std::move(new_tail);
+            if (new_tail_offset == 0) {
+                root = nullptr;
+                shift = trie::BITS;
+            } else {
+                root = trim(shift, root, new_tail_offset, edit, resource);
+                while (shift > trie::BITS && root->children.size() == 1) {
+                    root = root->children.front();
+                    shift -= trie::BITS;
+                }
+            }
+            count = new_count;
+        }
+    };
+
+        // zachlisp::persistent::cons
+        namespace cons {
+
+        template <class T>
+        struct Cell {
+            T first;
+            std::shared_ptr<Cell> rest;
+        };
+
+        }
+
+    // a persistent singly linked list. cons and rest are O(1) and the new
+    // list shares every cell of the old one.
+    template <class T>
+    class List {
+        using Cell = cons::Cell<T>;
+        using Ptr = std::shared_ptr<Cell>;
+
+    public:
+        using value_type = T;
+
+        class Iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const T *;
+            using reference = const T &;
+
+            Iterator() {}
+
+            explicit Iterator(const Cell *c) : cell(c) {}
+
+            reference operator*() const {
+                return cell->first;
+            }
+
+            pointer operator->() const {
+                return &cell->first;
+            }
+
+            Iterator & operator++() {
+                cell = cell->rest.get();
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                auto ret = *this;
+                ++*this;
+                return ret;
+            }
+
+            bool operator==(const Iterator & it) const {
+                return cell == it.cell;
+            }
+
+            bool operator!=(const Iterator & it) const {
+                return !(*this == it);
+            }
+
+        private:
+            const Cell *cell = nullptr;
+        };
+
+        using iterator = Iterator;
+        using const_iterator = Iterator;
+
+        // builds a list front to back, linking each new cell onto the last
+        // one. nothing else can see the cells until persistent is called.
+        class Builder {
+        public:
+            explicit Builder(Resource *r = std::pmr::get_default_resource()) : resource(r) {}
+
+            Builder(const Builder &) = delete;
+            Builder(Builder &&) = default;
+
+            void push_back(T item) {
+                auto cell = make(std::move(item), nullptr, resource);
+                auto next = cell.get();
+                if (last) {
+                    last->rest = std::move(cell);
+                } else {
+                    list.head = std::move(cell);
+                }
+                last = next;
+                ++list.count;
+            }
+
+            std::size_t size() const {
+                return list.size();
+            }
+
+            List persistent() {
+                last = nullptr;
+                return std::move(list);
+            }
+
+        private:
+            List list;
+            Cell *last = nullptr;
+            Resource *resource;
+        };
+
+        List() = default;
+        List(const List &) = default;
+        List(List && l) noexcept : head(std::move(l.head)), count(l.count) {
+            l.count = 0;
+        }
+
+        List & operator=(List l) {
+            std::swap(head, l.head);
+            std::swap(count, l.count);
+            return *this;
+        }
+
+        // cells are let go of one at a time, since letting the first
+        // one go would otherwise recurse down the whole list
+        ~List() {
+            while (head && head.use_count() == 1) {
+                auto rest = std::move(head->rest);
+                head = std::move(rest);
+            }
+        }
+
+        std::size_t size() const {
+            return count;
+        }
+
+        bool empty() const {
+            return count == 0;
+        }
+
+        iterator begin() const {
+            return iterator(head.get());
+        }
+
+        iterator end() const {
+            return iterator();
+        }
+
+        const T & front() const {
+            return head->first;
+        }
+
+        // every item but the first
+        List rest() const {
+            if (!head) {
+                return List();
+            }
+            return List(head->rest, count - 1);
+        }
+
+        List cons(T item) const {
+            return List(make(std::move(item), head, std::pmr::get_default_resource()), count + 1);
+        }
+
+        // whether both start at the same cell, and so hold the same items
+        bool identical(const List & l) const {
+            return head == l.head;
+        }
+
+    private:
+        Ptr head;
+        std::size_t count = 0;
+
+        List(Ptr h, std::size_t c) : head(std::move(h)), count(c) {}
+
+        static Ptr make(T && item, Ptr rest, Resource *resource) {
+            return std::allocate_shared<Cell>(std::pmr::polymorphic_allocator<Cell>(resource), Cell{std::move(item), std::move(rest)});
+        }
+    };
+    }
+}
@@ -4,11 +4,30 @@
 
 namespace zachlisp {
 
-std::string escape_str(std::string s) {
-    return std::regex_replace(s, std::regex("\""), "\\\"");
+std::string escape_str(std::string_view s) {
+    std::string ret;
+    ret.reserve(s.size());
+    for (auto c : s) {
+        switch (c) {
+            case '"':
+                ret += "\\\"";
+                break;
+            case '\\':
+                ret += "\\\\";
+                break;
+            case '\n':
+                ret += "\\n";
+                break;
+            default:
+                ret += c;
+        }
+    }
+    return ret;
 }
 
-std::string pr_str(token::Token token) {
+// strings are printed the way they would be read back in,
+// unless print_readably is false, when they are printed as they are
+std::string pr_str(const token::Token & token, bool print_readably = true) {
     switch (token.value.index()) {
         case token::value::BOOL:
             return std::get<bool>(token.value) ? "true" : "false";
@@ -18,76 +37,89 @@ std::string pr_str(token::Token token) {
             return std::to_string(std::get<long>(token.value));
         case token::value::DOUBLE:
             return std::to_string(std::get<double>(token.value));
+        case token::value::BIG_INT:
+            return std::get<token::value::BigInt>(token.value).text + "N";
+        case token::value::BIG_DECIMAL:
+            return std::get<token::value::BigDecimal>(token.value).text + "M";
+        case token::value::RATIO:
+            {
+                auto & ratio = std::get<token::value::Ratio>(token.value);
+                return std::to_string(ratio.numerator) + "/" + std::to_string(ratio.denominator);
+            }
         case token::value::STRING:
+        case token::value::VIEW:
+        case token::value::SYMBOL:
             {
-                std::string s = std::get<std::string>(token.value);
-                if (token.type == token::type::STRING) {
+                auto s = token::value::text(token.value);
+                if (token.type == token::type::STRING && print_readably) {
                     return "\"" + escape_str(s) + "\"";
                 } else {
-                    return s;
+                    return std::string(s);
                 }
             }
     }
     return "";
 }
 
-std::string pr_str(form::Form form);
+std::string pr_str(const form::Form & form, bool print_readably = true);
 
-std::string pr_str(form::FormWrapper formWrapper) {
-    return pr_str(formWrapper.form);
+std::string pr_str(const form::FormWrapper & formWrapper, bool print_readably = true) {
+    return pr_str(formWrapper.form, print_readably);
 }
 
-std::string pr_str(std::string s) {
+std::string pr_str(const std::string & s) {
     return s;
 }
 
 template <class T>
-std::string pr_str(T list) {
+std::string pr_str(const T & list, bool print_readably = true) {
     std::string s;
-    for (auto item : list) {
+    for (auto & item : list) {
         if (s.size() > 0) {
             s += " ";
         }
-        s += pr_str(item);
+        s += pr_str(item, print_readably);
     }
     return s;
 }
 
-std::string pr_str(form::FormWrapperMap map) {
+std::string pr_str(const form::FormWrapperMap & map, bool print_readably = true) {
     std::string s;
-    for (auto item : map) {
+    for (auto & item : map) {
         if (s.size() > 0) {
             s += " ";
         }
-        s += pr_str(item.first.form) + " " + pr_str(item.second.form);
+        s += pr_str(item.first.form, print_readably) + " " + pr_str(item.second.form, print_readably);
     }
     return s;
 }
 
-std::string pr_str(form::Form form) {
+std::string pr_str(const form::Form & form, bool print_readably) {
     switch (form.index()) {
         case form::SPECIAL:
             {
-                auto error = std::get<form::Special>(form);
+                auto & error = form::get<form::Special>(form);
                 return "#" + error.name + " \"" + escape_str(error.message) + "\"";
             }
         case form::TOKEN:
-            return pr_str(std::get<token::Token>(form));
+            return pr_str(form.token(), print_readably);
         case form::LIST:
-            return "(" + pr_str<std::list<form::FormWrapper> >(std::get<std::list<form::FormWrapper> >(form)) + ")";
+            return "(" + pr_str<form::List>(form::get<form::List>(form), print_readably) + ")";
         case form::VECTOR:
-            return "[" + pr_str<std::vector<form::FormWrapper> >(std::get<std::vector<form::FormWrapper> >(form)) + "]";
+            return "[" + pr_str<form::Vector>(form::get<form::Vector>(form), print_readably) + "]";
         case form::MAP:
-            return "{" + pr_str(*std::get<std::shared_ptr<form::FormWrapperMap>>(form)) + "}";
+            return "{" + pr_str(form::get<form::FormWrapperMap>(form), print_readably) + "}";
         case form::SET:
-            return "#{" + pr_str<form::FormWrapperSet>(*std::get<std::shared_ptr<form::FormWrapperSet>>(form)) + "}";
+            return "#{" + pr_str<form::FormWrapperSet>(form::get<form::FormWrapperSet>(form), print_readably) + "}";
+        case form::FN:
+            return "#<function>";
     }
     return "";
 }
 
-std::string print(const std::list<form::Form> forms) {
+std::string print(const std::list<form::Form> & forms) {
     std::string s;
-    for (auto form : forms) {
+    for (auto & form : forms) {
         s += pr_str(form) + "\n";
     }
     return s;
@@ -2,11 +2,47 @@
 
 #include <string>
 #include <list>
+#include <memory>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
 #include <variant>
-#include <regex>
+#include <optional>
+#include <algorithm>
+#include <array>
+#include <string_view>
+#include <functional>
+#include <istream>
+#include <cerrno>
+#include <thread>
+#include <atomic>
+#include <charconv>
+#include <numeric>
+#include <limits>
+#include <cstdint>
+#include <mutex>
+#include <deque>
+#include <memory_resource>
+
+#if __has_include(<unistd.h>)
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define ZACHLISP_SIMD
+#include <immintrin.h>
+#endif
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#include <fstream>
+#include <sstream>
+#endif
+
+#include "persistent.hpp"
 
 namespace zachlisp {
 
@@ -23,21 +59,149 @@ namespace zachlisp {
         // zachlisp::token::value
         namespace value {
 
-        using Value = std::variant<bool, char, long, double, std::string>;
+        // integers that don't fit in a long or end in N, and decimals that
+        // don't fit in a double or end in M. there is no arbitrary precision
+        // arithmetic, so they keep the text of the literal without the suffix.
+        struct BigInt {
+            std::string text;
 
-        enum Type {BOOL, CHAR, LONG, DOUBLE, STRING};
+            bool operator==(const BigInt & b) const {
+                return text == b.text;
+            }
+        };
+
+        struct BigDecimal {
+            std::string text;
+
+            bool operator==(const BigDecimal & b) const {
+                return text == b.text;
+            }
+        };
+
+        // always reduced, with a positive denominator other than 1
+        struct Ratio {
+            long numerator;
+            long denominator;
+
+            bool operator==(const Ratio & r) const {
+                return (numerator == r.numerator) && (denominator == r.denominator);
+            }
+        };
+
+        // the name of an interned symbol, along with its hash
+        struct Name {
+            std::string text;
+            std::size_t hash;
+        };
+
+        // a symbol or keyword. there is only one Name for each symbol,
+        // so they can be compared by address and used as stable keys.
+        struct Symbol {
+            const Name *name;
+
+            bool operator==(const Symbol & s) const {
+                return name == s.name;
+            }
+        };
+
+        // the names of every symbol ever interned. it is split into
+        // shards with their own locks so threads reading in parallel
+        // don't all wait on the same one.
+        class SymbolTable {
+        public:
+            Symbol intern(std::string_view text) {
+                std::size_t hash = std::hash<std::string_view>()(text);
+                auto & shard = shards[hash % shards.size()];
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                auto it = shard.symbols.find(text);
+                if (it != shard.symbols.end()) {
+                    return it->second;
+                }
+                // a deque never moves its elements, so the names stay put
+                auto & name = shard.names.emplace_back(Name{std::string(text), hash});
+                Symbol symbol{&name};
+                shard.symbols.emplace(name.text, symbol);
+                return symbol;
+            }
+
+        private:
+            struct Shard {
+                std::mutex mutex;
+                std::deque<Name> names;
+                std::unordered_map<std::string_view, Symbol> symbols;
+            };
+
+            std::array<Shard, 16> shards;
+        };
 
+        Symbol intern(std::string_view text) {
+            static SymbolTable table;
+            return table.intern(text);
         }
 
-    const std::regex REGEX(
-        "([\\s,]+)|"                   // type::WHITESPACE
-        "(~@|#\\{)|"                   // type::SPECIAL_CHARS
-        "([\\[\\]{}()\'`~^@])|"        // type::SPECIAL_CHAR
-        "(\"(?:\\\\.|[^\\\\\"])*\"?)|" // type::STRING
-        "(;.*)|"                       // type::COMMENT
-        "(\\d+\\.?\\d*)|"              // type::NUMBER
-        "([^\\s\\[\\]{}(\'\"`,;)]+)"   // type::SYMBOL
-    );
+        // VIEW is a slice of the input that was read,
+        // so it is only valid as long as the input is
+        using Value = std::variant<bool, char, long, double, std::string, std::string_view, BigInt, BigDecimal, Ratio, Symbol>;
+
+        enum Type {BOOL, CHAR, LONG, DOUBLE, STRING, VIEW, BIG_INT, BIG_DECIMAL, RATIO, SYMBOL};
+
+        // returns the characters of a STRING, VIEW or SYMBOL value
+        std::string_view text(const Value & value) {
+            if (auto s = std::get_if<std::string>(&value)) {
+                return *s;
+            } else if (auto s = std::get_if<Symbol>(&value)) {
+                return s->name->text;
+            }
+            return std::get<std::string_view>(value);
+        }
+
+        bool is_text(Type type) {
+            return type == STRING || type == VIEW || type == SYMBOL;
+        }
+
+        bool is_text(const Value & value) {
+            return is_text(Type(value.index()));
+        }
+
+        }
+
+        // zachlisp::token::chars
+        namespace chars {
+
+        enum Class : unsigned char {
+            WHITESPACE = 1 << 0, // \s and ,
+            SPECIAL = 1 << 1,    // []{}()'`~^@
+            DIGIT = 1 << 2,      // 0-9
+            SYMBOL = 1 << 3      // anything that can continue a symbol
+        };
+
+        constexpr void mark(std::array<unsigned char, 256> & table, std::string_view chars, unsigned char cls) {
+            for (auto c : chars) {
+                table[static_cast<unsigned char>(c)] = cls;
+            }
+        }
+
+        constexpr std::array<unsigned char, 256> make_table() {
+            std::array<unsigned char, 256> table{};
+            for (auto & cls : table) {
+                cls = SYMBOL;
+            }
+            mark(table, " \t\n\v\f\r,", WHITESPACE);
+            mark(table, "[]{}()'`", SPECIAL);
+            // these start a special char but may also appear inside a symbol
+            mark(table, "~^@", SPECIAL | SYMBOL);
+            mark(table, "0123456789", DIGIT | SYMBOL);
+            mark(table, "\";", 0);
+            return table;
+        }
+
+        constexpr std::array<unsigned char, 256> TABLE = make_table();
+
+        inline bool is(char c, unsigned char cls) {
+            return TABLE[static_cast<unsigned char>(c)] & cls;
+        }
+
+        }
 
     struct Token {
         value::Value value;
@@ -45,13 +209,20 @@ namespace zachlisp {
         int line;
         int column;
 
-        Token(value::Value v, type::Type t, int l, int c) : value(v), type(t), line(l), column(c) {}
+        Token(value::Value v, type::Type t, int l, int c) : value(std::move(v)), type(t), line(l), column(c) {}
 
         bool operator==(const Token & t) const {
+            if (value.index() == value::SYMBOL && t.value.index() == value::SYMBOL) {
+                return (std::get<value::Symbol>(value) == std::get<value::Symbol>(t.value)) && (type == t.type);
+            } else if (value::is_text(value) && value::is_text(t.value)) {
+                return (value::text(value) == value::text(t.value)) && (type == t.type);
+            }
             return (value == t.value) && (type == t.type);
         }
     };
 
+    using Tokens = std::vector<Token>;
+
     }
 
     // zachlisp::form
@@ -62,7 +233,7 @@ namespace zachlisp {
         std::string message;
         std::optional<token::Token> token;
 
-        Special(std::string n, std::string m, std::optional<token::Token> t) : name(n), message(m), token(t) {}
+        Special(std::string n, std::string m, std::optional<token::Token> t) : name(std::move(n)), message(std::move(m)), token(std::move(t)) {}
 
         bool operator==(const Special & re) const {
             return (!message.compare(re.message)) && (token == re.token);
@@ -72,24 +243,193 @@ namespace zachlisp {
     struct FormWrapper;
     class FormWrapperHash;
     class FormWrapperEquality;
+    class Form;
+
+    // collections are persistent and take their nodes from a memory
+    // resource, so a read can put a whole tree in an arena. copies share
+    // nodes, arena and all.
+    using List = persistent::List<FormWrapper>;
+    using Vector = persistent::Vector<FormWrapper>;
+    // map keys and set items need to be hashable,
+    // and that isn't implemented until later...
+    using FormWrapperMap = persistent::Map<FormWrapper, FormWrapper, FormWrapperHash, FormWrapperEquality>;
+    using FormWrapperSet = persistent::Set<FormWrapper, FormWrapperHash, FormWrapperEquality>;
+
+    // a function. the reader never makes these, only evaluation does,
+    // so what they hold is up to the evaluator that made them
+    struct Callable {
+        virtual ~Callable() = default;
+    };
+
+    using Fn = std::unique_ptr<Callable>;
+
+    enum Type {SPECIAL, TOKEN, LIST, VECTOR, MAP, SET, FN};
+
+    // the part of a form that lives on the heap: errors, strings, big numbers
+    // and collections. they never change once they're made, so forms share
+    // them and count references to know when to let them go.
+    struct Object {
+        mutable std::atomic<std::size_t> references{1};
+        persistent::Resource *resource;
+        // collections work out their hash the first time it's needed.
+        // zero means it hasn't been worked out yet
+        mutable std::size_t hash_code = 0;
+
+        Object(persistent::Resource *r) : resource(r) {}
+    };
+
+    template <class T>
+    struct Box : Object {
+        T value;
+
+        Box(T v, persistent::Resource *r) : Object(r), value(std::move(v)) {}
+    };
 
-    using FormWrapperMap = std::unordered_map<FormWrapper, FormWrapper, FormWrapperHash, FormWrapperEquality>;
-    using FormWrapperSet = std::unordered_set<FormWrapper, FormWrapperHash, FormWrapperEquality>;
+    // a form in 16 bytes. the first 8 say what kind of form it is and, for
+    // tokens, their type and the position they were read from. the other 8 hold
+    // bools, chars, longs, doubles and symbols themselves, and a pointer to
+    // the object holding anything else.
+    class Form {
+    public:
+        Form(token::Token token, persistent::Resource *resource = std::pmr::get_default_resource());
+        Form(Special special, persistent::Resource *resource = std::pmr::get_default_resource());
+        Form(List list, persistent::Resource *resource = std::pmr::get_default_resource());
+        Form(Vector vector, persistent::Resource *resource = std::pmr::get_default_resource());
+        Form(FormWrapperMap map, persistent::Resource *resource = std::pmr::get_default_resource());
+        Form(FormWrapperSet set, persistent::Resource *resource = std::pmr::get_default_resource());
+        Form(Fn fn, persistent::Resource *resource = std::pmr::get_default_resource());
+
+        Form(const Form & f) : type(f.type), token_kind(f.token_kind), value_kind(f.value_kind), position_high(f.position_high), position(f.position), payload(f.payload) {
+            if (boxed()) {
+                payload.object->references.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        Form(Form && f) noexcept : type(f.type), token_kind(f.token_kind), value_kind(f.value_kind), position_high(f.position_high), position(f.position), payload(f.payload) {
+            f.type = MOVED;
+        }
+
+        Form & operator=(Form f) noexcept {
+            std::swap(type, f.type);
+            std::swap(token_kind, f.token_kind);
+            std::swap(value_kind, f.value_kind);
+            std::swap(position_high, f.position_high);
+            std::swap(position, f.position);
+            std::swap(payload, f.payload);
+            return *this;
+        }
+
+        ~Form();
+
+        Type index() const {
+            return Type(type);
+        }
+
+        token::type::Type token_type() const {
+            return token::type::Type(token_kind);
+        }
+
+        token::value::Type value_type() const {
+            return token::value::Type(value_kind);
+        }
+
+        // the token this form was made from. strings come back as views of
+        // the form's own copy, so they're only valid as long as it is.
+        token::Token token() const;
 
-    using Form = std::variant<
-        Special,
-        token::Token,
-        std::list<FormWrapper>,
-        std::vector<FormWrapper>,
-        // maps and sets must be stored with a layer of indirection
-        // to satisfy the type syetem.
-        // their content needs to be hashable
-        // and that isn't implemented until later...
-        std::shared_ptr<FormWrapperMap>,
-        std::shared_ptr<FormWrapperSet>
-    >;
+        // the text of a string or symbol
+        std::string_view text() const;
 
-    enum Type {SPECIAL, TOKEN, LIST, VECTOR, MAP, SET};
+        // the interned name of a symbol
+        const token::value::Name * token_symbol() const {
+            return payload.name;
+        }
+
+        // the bool, long or double in a token, which has to be of that type
+        bool token_bool() const {
+            return payload.b;
+        }
+
+        long token_long() const {
+            return payload.l;
+        }
+
+        double token_double() const {
+            return payload.d;
+        }
+
+        const Object * object() const {
+            return payload.object;
+        }
+
+    private:
+        // what's left after a form is moved from
+        static const std::uint8_t MOVED = 0xff;
+
+        std::uint8_t type;
+        std::uint8_t token_kind = 0;
+        std::uint8_t value_kind = 0;
+        // the line in the top 24 of these 40 bits and the column in the
+        // bottom 16, so positions live and die with the forms. lines and
+        // columns past what fits are kept at the most that does
+        std::uint8_t position_high = 0;
+        std::uint32_t position = 0;
+        union {
+            bool b;
+            char c;
+            long l;
+            double d;
+            const token::value::Name *name;
+            Object *object;
+        } payload;
+
+        bool boxed() const {
+            switch (type) {
+                case TOKEN:
+                    switch (value_kind) {
+                        case token::value::STRING:
+                        case token::value::VIEW:
+                        case token::value::BIG_INT:
+                        case token::value::BIG_DECIMAL:
+                        case token::value::RATIO:
+                            return true;
+                    }
+                    return false;
+                case MOVED:
+                    return false;
+            }
+            return true;
+        }
+
+        template <class T>
+        static Object * box(T value, persistent::Resource *resource) {
+            std::pmr::polymorphic_allocator<Box<T>> allocator(resource);
+            auto box = allocator.allocate(1);
+            new (box) Box<T>(std::move(value), resource);
+            return box;
+        }
+
+        template <class T>
+        static void release(Object *object) {
+            if (object->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                auto box = static_cast<Box<T> *>(object);
+                std::pmr::polymorphic_allocator<Box<T>> allocator(box->resource);
+                box->~Box<T>();
+                allocator.deallocate(box, 1);
+            }
+        }
+
+        template <class T>
+        friend const T & get(const Form & f);
+    };
+
+    static_assert(sizeof(Form) == 16);
+
+    // the error or collection in a form, which has to be of that type
+    template <class T>
+    const T & get(const Form & f) {
+        return static_cast<const Box<T> *>(f.payload.object)->value;
+    }
 
     std::size_t hash(const FormWrapper & fw);
     bool equals(const FormWrapper & fw1, const FormWrapper & fw2);
@@ -111,8 +451,40 @@ inline void hash_combine(std::size_t& seed, const T& v, Rest... rest) {
 
 namespace std {
 
+template <> struct hash<zachlisp::token::value::BigInt> {
+    size_t operator()(const zachlisp::token::value::BigInt & x) const {
+        return std::hash<std::string>()(x.text);
+    }
+};
+
+template <> struct hash<zachlisp::token::value::BigDecimal> {
+    size_t operator()(const zachlisp::token::value::BigDecimal & x) const {
+        return std::hash<std::string>()(x.text);
+    }
+};
+
+template <> struct hash<zachlisp::token::value::Ratio> {
+    size_t operator()(const zachlisp::token::value::Ratio & x) const {
+        size_t seed = 0;
+        zachlisp::hash_combine(seed, x.numerator, x.denominator);
+        return seed;
+    }
+};
+
+template <> struct hash<zachlisp::token::value::Symbol> {
+    size_t operator()(const zachlisp::token::value::Symbol & x) const {
+        return x.name->hash;
+    }
+};
+
 template <> struct hash<zachlisp::token::Token> {
     size_t operator()(const zachlisp::token::Token & x) const {
+        if (auto s = std::get_if<zachlisp::token::value::Symbol>(&x.value)) {
+            // the same as hashing its text, without looking at it again
+            return s->name->hash;
+        } else if (zachlisp::token::value::is_text(x.value)) {
+            return std::hash<std::string_view>()(zachlisp::token::value::text(x.value));
+        }
         return std::hash<zachlisp::token::value::Value>()(x.value);
     }
 };
@@ -136,47 +508,393 @@ namespace zachlisp {
     // zachlisp::token
     namespace token {
 
-    value::Value parse(std::string value, type::Type type) {
+    // parses a NUMBER token without allocating, unless it needs a BigInt
+    // or BigDecimal. if it can't be parsed, its text is returned instead.
+    value::Value parse_number(std::string_view value, bool view) {
+        std::string_view s = value;
+        if (s[0] == '+') {
+            // from_chars only accepts a minus sign
+            s.remove_prefix(1);
+        }
+        bool negative = s[0] == '-';
+        std::string_view digits = negative ? s.substr(1) : s;
+        const char *first = s.data();
+        const char *last = s.data() + s.size();
+
+        if (s.back() == 'N') {
+            return value::BigInt{std::string(s.substr(0, s.size() - 1))};
+        } else if (s.back() == 'M') {
+            return value::BigDecimal{std::string(s.substr(0, s.size() - 1))};
+        } else if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+            long l;
+            auto ret = std::from_chars(digits.data() + 2, last, l, 16);
+            if (ret.ec == std::errc::result_out_of_range) {
+                return value::BigInt{std::string(s)};
+            }
+            return negative ? -l : l;
+        } else if (auto slash = s.find('/'); slash != std::string_view::npos) {
+            long numerator, denominator;
+            auto ret = std::from_chars(first, first + slash, numerator);
+            auto ret2 = std::from_chars(first + slash + 1, last, denominator);
+            if (ret.ec == std::errc::result_out_of_range || ret2.ec == std::errc::result_out_of_range) {
+                double n, d;
+                std::from_chars(first, first + slash, n);
+                std::from_chars(first + slash + 1, last, d);
+                return n / d;
+            } else if (denominator == 0) {
+                // not a number, so the reader turns it into an error
+                return view ? value::Value{value} : value::Value{std::string(value)};
+            }
+            long divisor = std::gcd(numerator, denominator);
+            numerator /= divisor;
+            denominator /= divisor;
+            if (denominator == 1) {
+                return numerator;
+            }
+            return value::Ratio{numerator, denominator};
+        } else if (s.find_first_of(".eE") != std::string_view::npos) {
+            double d;
+            auto ret = std::from_chars(first, last, d);
+            if (ret.ec == std::errc::result_out_of_range) {
+                return value::BigDecimal{std::string(s)};
+            }
+            return d;
+        } else {
+            long l;
+            auto ret = std::from_chars(first, last, l);
+            if (ret.ec == std::errc::result_out_of_range) {
+                return value::BigInt{std::string(s)};
+            }
+            return l;
+        }
+    }
+
+    value::Value parse(std::string_view value, type::Type type, bool view = false) {
         switch (type) {
             case type::SPECIAL_CHAR:
                 return value[0];
             case type::NUMBER:
-                if (value.find('.') == std::string::npos) {
-                    return std::stol(value);
-                } else {
-                    return std::stod(value);
-                }
+                return parse_number(value, view);
             case type::SYMBOL:
                 if (value == "true") {
                     return true;
                 } else if (value == "false") {
                     return false;
                 }
+                return value::intern(value);
         }
-        return value;
+        if (view) {
+            return value;
+        }
+        return std::string(value);
     }
 
-    std::list<Token> tokenize(std::string input) {
-        std::sregex_iterator begin(input.begin(), input.end(), REGEX);
-        std::sregex_iterator end;
+        // zachlisp::token::simd
+        namespace simd {
+
+        // where to stop when skipping through the input
+        enum Stop {
+            END_OF_WHITESPACE, // anything but whitespace
+            END_OF_SYMBOL,     // anything that can't continue a symbol
+            END_OF_STRING,     // a quote or a backslash
+            END_OF_COMMENT     // a line break
+        };
+
+        inline bool stops(char c, Stop stop) {
+            switch (stop) {
+                case END_OF_WHITESPACE:
+                    return !chars::is(c, chars::WHITESPACE);
+                case END_OF_SYMBOL:
+                    return !chars::is(c, chars::SYMBOL);
+                case END_OF_STRING:
+                    return c == '"' || c == '\\';
+                case END_OF_COMMENT:
+                    return c == '\n' || c == '\r';
+            }
+            return true;
+        }
+
+        std::size_t skip_scalar(std::string_view input, std::size_t pos, Stop stop) {
+            while (pos < input.size() && !stops(input[pos], stop)) {
+                ++pos;
+            }
+            return pos;
+        }
+
+#ifdef ZACHLISP_SIMD
 
-        std::list<Token> tokens;
+        // SSE2 is always there on x86-64, but has no byte shuffle,
+        // so the character classes are built out of comparisons
+        inline unsigned sse2_mask(__m128i c, Stop stop) {
+            auto eq = [c](char x) {
+                return _mm_cmpeq_epi8(c, _mm_set1_epi8(x));
+            };
+            switch (stop) {
+                case END_OF_WHITESPACE:
+                case END_OF_SYMBOL:
+                    {
+                        // \t through \r are 9 through 13
+                        __m128i control = _mm_sub_epi8(c, _mm_set1_epi8(9));
+                        __m128i ws = _mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8(4)), control);
+                        ws = _mm_or_si128(ws, _mm_or_si128(eq(' '), eq(',')));
+                        if (stop == END_OF_WHITESPACE) {
+                            return ~_mm_movemask_epi8(ws) & 0xFFFF;
+                        }
+                        __m128i special = _mm_or_si128(_mm_or_si128(eq('('), eq(')')), _mm_or_si128(eq('['), eq(']')));
+                        special = _mm_or_si128(special, _mm_or_si128(eq('{'), eq('}')));
+                        special = _mm_or_si128(special, _mm_or_si128(eq('\''), eq('`')));
+                        special = _mm_or_si128(special, _mm_or_si128(eq('"'), eq(';')));
+                        return _mm_movemask_epi8(_mm_or_si128(ws, special));
+                    }
+                case END_OF_STRING:
+                    return _mm_movemask_epi8(_mm_or_si128(eq('"'), eq('\\')));
+                case END_OF_COMMENT:
+                    return _mm_movemask_epi8(_mm_or_si128(eq('\n'), eq('\r')));
+            }
+            return 0xFFFF;
+        }
 
-        int line = 1;
+        std::size_t skip_sse2(std::string_view input, std::size_t pos, Stop stop) {
+            while (pos + 16 <= input.size()) {
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input.data() + pos));
+                if (unsigned mask = sse2_mask(c, stop)) {
+                    return pos + __builtin_ctz(mask);
+                }
+                pos += 16;
+            }
+            return skip_scalar(input, pos, stop);
+        }
 
-        for (auto it = begin; it != end; ++it) {
-            std::smatch match = *it;
-            for(auto i = 1; i < match.size(); ++i){
-               if (!match[i].str().empty()) {
-                   std::string value_str = match.str();
-                   type::Type type = static_cast<type::Type>(i-1);
-                   value::Value value = parse(value_str, type);
-                   int column = match.position() + 1;
-                   tokens.push_back(Token{value, type, line, column});
-                   line += std::count(value_str.begin(), value_str.end(), '\n');
-                   break;
-               }
+        // AVX2 classifies bytes by looking up their low and high nibbles
+        // in two tables and and-ing the results, like simdjson does.
+        // bits 0 and 1 are whitespace, the rest are other symbol enders:
+        //   bit 0: \t \n \v \f \r    bit 1: space ,
+        //   bit 2: " ' ( )          bit 3: ; [ {
+        //   bit 4: ] }              bit 5: `
+        __attribute__((target("avx2")))
+        inline unsigned avx2_mask(__m256i c, Stop stop) {
+            auto eq = [c](char x) __attribute__((target("avx2"))) {
+                return _mm256_cmpeq_epi8(c, _mm256_set1_epi8(x));
+            };
+            switch (stop) {
+                case END_OF_WHITESPACE:
+                case END_OF_SYMBOL:
+                    {
+                        const __m256i low_table = _mm256_setr_epi8(
+                            0x22, 0, 0x04, 0, 0, 0, 0, 0x04, 0x04, 0x05, 0x01, 0x09, 0x03, 0x11, 0, 0,
+                            0x22, 0, 0x04, 0, 0, 0, 0, 0x04, 0x04, 0x05, 0x01, 0x09, 0x03, 0x11, 0, 0);
+                        const __m256i high_table = _mm256_setr_epi8(
+                            0x01, 0, 0x06, 0x08, 0, 0x18, 0x20, 0x18, 0, 0, 0, 0, 0, 0, 0, 0,
+                            0x01, 0, 0x06, 0x08, 0, 0x18, 0x20, 0x18, 0, 0, 0, 0, 0, 0, 0, 0);
+                        const __m256i nibble = _mm256_set1_epi8(0x0F);
+                        __m256i low = _mm256_shuffle_epi8(low_table, _mm256_and_si256(c, nibble));
+                        __m256i high = _mm256_shuffle_epi8(high_table, _mm256_and_si256(_mm256_srli_epi16(c, 4), nibble));
+                        __m256i cls = _mm256_and_si256(low, high);
+                        __m256i zero = _mm256_setzero_si256();
+                        if (stop == END_OF_WHITESPACE) {
+                            cls = _mm256_and_si256(cls, _mm256_set1_epi8(0x03));
+                            return _mm256_movemask_epi8(_mm256_cmpeq_epi8(cls, zero));
+                        }
+                        return ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(cls, zero));
+                    }
+                case END_OF_STRING:
+                    return _mm256_movemask_epi8(_mm256_or_si256(eq('"'), eq('\\')));
+                case END_OF_COMMENT:
+                    return _mm256_movemask_epi8(_mm256_or_si256(eq('\n'), eq('\r')));
             }
+            return 0xFFFFFFFF;
+        }
+
+        __attribute__((target("avx2")))
+        std::size_t skip_avx2(std::string_view input, std::size_t pos, Stop stop) {
+            while (pos + 32 <= input.size()) {
+                __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input.data() + pos));
+                if (unsigned mask = avx2_mask(c, stop)) {
+                    return pos + __builtin_ctz(mask);
+                }
+                pos += 32;
+            }
+            return skip_sse2(input, pos, stop);
+        }
+
+#endif
+
+        using Skip = std::size_t (*)(std::string_view, std::size_t, Stop);
+
+        Skip select_skip() {
+#ifdef ZACHLISP_SIMD
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                return skip_avx2;
+            }
+            return skip_sse2;
+#else
+            return skip_scalar;
+#endif
+        }
+
+        // returns the first position at or after pos where the stop
+        // condition holds, using the widest instructions this cpu has
+        Skip skip = select_skip();
+
+        }
+
+    // finds the end of a number, which is one of
+    //   [+-]?0[xX][0-9a-fA-F]+N?
+    //   [+-]?\d+/\d+
+    //   [+-]?\d+N
+    //   [+-]?\d+(\.\d*)?([eE][+-]?\d+)?M?
+    // anything after that starts the next token
+    std::size_t scan_number(std::string_view input, std::size_t pos) {
+        const std::size_t size = input.size();
+        auto skip_digits = [&](std::size_t p) {
+            while (p < size && chars::is(input[p], chars::DIGIT)) {
+                ++p;
+            }
+            return p;
+        };
+        auto at = [&](std::size_t p, std::string_view cs) {
+            return p < size && cs.find(input[p]) != std::string_view::npos;
+        };
+
+        if (at(pos, "+-")) {
+            ++pos;
+        }
+        if (input[pos] == '0' && at(pos + 1, "xX") && at(pos + 2, "0123456789abcdefABCDEF")) {
+            pos += 2;
+            while (at(pos, "0123456789abcdefABCDEF")) {
+                ++pos;
+            }
+            return at(pos, "N") ? pos + 1 : pos;
+        }
+        pos = skip_digits(pos);
+        if (at(pos, "N")) {
+            return pos + 1;
+        } else if (at(pos, "/") && pos + 1 < size && chars::is(input[pos + 1], chars::DIGIT)) {
+            return skip_digits(pos + 1);
+        }
+        if (at(pos, ".")) {
+            pos = skip_digits(pos + 1);
+        }
+        if (at(pos, "eE")) {
+            std::size_t p = at(pos + 1, "+-") ? pos + 2 : pos + 1;
+            if (p < size && chars::is(input[p], chars::DIGIT)) {
+                pos = skip_digits(p);
+            }
+        }
+        return at(pos, "M") ? pos + 1 : pos;
+    }
+
+    // whether the number scan_number stopped at could still go on if
+    // more input came after rest, which is everything left after it:
+    // a partial exponent, ratio or hex prefix
+    bool number_may_continue(std::string_view number, std::string_view rest) {
+        if (rest == "/") {
+            return number.find_first_of("./eExXNM") == std::string_view::npos;
+        } else if (rest == "x" || rest == "X") {
+            return number == "0" || number == "+0" || number == "-0";
+        } else if (!rest.empty() && (rest[0] == 'e' || rest[0] == 'E') &&
+                   (rest.size() == 1 || (rest.size() == 2 && (rest[1] == '+' || rest[1] == '-')))) {
+            return number.find_first_of("/eExXNM") == std::string_view::npos;
+        }
+        return false;
+    }
+
+    // finds the end of the token starting at pos, trying the
+    // token types in the same order of priority as the old regex
+    std::size_t scan(std::string_view input, std::size_t pos, type::Type & type) {
+        const std::size_t size = input.size();
+        const char c = input[pos];
+        switch (c) {
+            case '~':
+                if (pos + 1 < size && input[pos + 1] == '@') {
+                    type = type::SPECIAL_CHARS;
+                    return pos + 2;
+                }
+                type = type::SPECIAL_CHAR;
+                return pos + 1;
+            case '#':
+                if (pos + 1 < size && input[pos + 1] == '{') {
+                    type = type::SPECIAL_CHARS;
+                    return pos + 2;
+                }
+                break;
+            case '"':
+                type = type::STRING;
+                ++pos;
+                while ((pos = simd::skip(input, pos, simd::END_OF_STRING)) < size) {
+                    if (input[pos] == '\\') {
+                        // an escape can't consume a line break
+                        if (pos + 1 < size && input[pos + 1] != '\n' && input[pos + 1] != '\r') {
+                            pos += 2;
+                        } else {
+                            return pos;
+                        }
+                    } else {
+                        return pos + 1;
+                    }
+                }
+                return pos;
+            case ';':
+                type = type::COMMENT;
+                return simd::skip(input, pos, simd::END_OF_COMMENT);
+            case '+':
+            case '-':
+                if (pos + 1 < size && chars::is(input[pos + 1], chars::DIGIT)) {
+                    type = type::NUMBER;
+                    return scan_number(input, pos);
+                }
+                break;
+        }
+
+        if (chars::is(c, chars::WHITESPACE)) {
+            type = type::WHITESPACE;
+            pos = simd::skip(input, pos, simd::END_OF_WHITESPACE);
+        } else if (chars::is(c, chars::SPECIAL)) {
+            type = type::SPECIAL_CHAR;
+            ++pos;
+        } else if (chars::is(c, chars::DIGIT)) {
+            type = type::NUMBER;
+            pos = scan_number(input, pos);
+        } else {
+            type = type::SYMBOL;
+            pos = simd::skip(input, pos, simd::END_OF_SYMBOL);
+        }
+        return pos;
+    }
+
+    // moves line on past a token that may have newlines in it, and
+    // line_start to where the line after the last one starts
+    template <class Offset>
+    void count_lines(type::Type type, std::string_view value_str, Offset pos, int & line, Offset & line_start) {
+        if (type != type::WHITESPACE && type != type::STRING) {
+            return;
+        }
+        auto last = value_str.rfind('\n');
+        if (last != std::string_view::npos) {
+            line += std::count(value_str.begin(), value_str.end(), '\n');
+            line_start = pos + last + 1;
+        }
+    }
+
+    // when view is true, the values of the tokens are slices of the input
+    // instead of copies, so the input must outlive them.
+    // line and column say where the input starts if it is part of a larger one.
+    Tokens tokenize(std::string_view input, bool view = false, int line = 1, int column = 1) {
+        Tokens tokens;
+
+        std::size_t pos = 0;
+        // where the line pos is on starts, which is before the input for its first line
+        std::ptrdiff_t line_start = 1 - column;
+
+        while (pos < input.size()) {
+            type::Type type;
+            std::size_t end = scan(input, pos, type);
+            std::string_view value_str = input.substr(pos, end - pos);
+            value::Value value = parse(value_str, type, view);
+            tokens.push_back(Token{value, type, line, static_cast<int>(static_cast<std::ptrdiff_t>(pos) - line_start + 1)});
+            count_lines(type, value_str, static_cast<std::ptrdiff_t>(pos), line, line_start);
+            pos = end;
         }
 
         return tokens;
@@ -190,7 +908,7 @@ namespace zachlisp {
     struct FormWrapper {
         Form form;
 
-        FormWrapper(Form f) : form(f) {}
+        FormWrapper(Form f) : form(std::move(f)) {}
 
         bool operator==(const FormWrapper & fw) const {
             return equals(*this, fw);
@@ -210,69 +928,371 @@ namespace zachlisp {
             return equals(fw1, fw2);
         }
     };
+
+    // the members of Form that need FormWrapper to be complete
+
+    Form::Form(token::Token token, persistent::Resource *resource) : type(TOKEN), token_kind(token.type), value_kind(token.value.index()) {
+        std::uint64_t line = std::clamp(token.line, 0, (1 << 24) - 1);
+        std::uint64_t column = std::clamp(token.column, 0, (1 << 16) - 1);
+        std::uint64_t packed = line << 16 | column;
+        position_high = packed >> 32;
+        position = static_cast<std::uint32_t>(packed);
+        switch (value_kind) {
+            case token::value::BOOL:
+                payload.b = std::get<bool>(token.value);
+                break;
+            case token::value::CHAR:
+                payload.c = std::get<char>(token.value);
+                break;
+            case token::value::LONG:
+                payload.l = std::get<long>(token.value);
+                break;
+            case token::value::DOUBLE:
+                payload.d = std::get<double>(token.value);
+                break;
+            case token::value::STRING:
+                payload.object = box(std::move(std::get<std::string>(token.value)), resource);
+                break;
+            case token::value::VIEW:
+                payload.object = box(std::get<std::string_view>(token.value), resource);
+                break;
+            case token::value::BIG_INT:
+                payload.object = box(std::move(std::get<token::value::BigInt>(token.value)), resource);
+                break;
+            case token::value::BIG_DECIMAL:
+                payload.object = box(std::move(std::get<token::value::BigDecimal>(token.value)), resource);
+                break;
+            case token::value::RATIO:
+                payload.object = box(std::get<token::value::Ratio>(token.value), resource);
+                break;
+            case token::value::SYMBOL:
+                payload.name = std::get<token::value::Symbol>(token.value).name;
+                break;
+        }
+    }
+
+    Form::Form(Special special, persistent::Resource *resource) : type(SPECIAL) {
+        payload.object = box(std::move(special), resource);
+    }
+
+    Form::Form(List list, persistent::Resource *resource) : type(LIST) {
+        payload.object = box(std::move(list), resource);
+    }
+
+    Form::Form(Vector vector, persistent::Resource *resource) : type(VECTOR) {
+        payload.object = box(std::move(vector), resource);
+    }
+
+    Form::Form(FormWrapperMap map, persistent::Resource *resource) : type(MAP) {
+        payload.object = box(std::move(map), resource);
+    }
+
+    Form::Form(FormWrapperSet set, persistent::Resource *resource) : type(SET) {
+        payload.object = box(std::move(set), resource);
+    }
+
+    Form::Form(Fn fn, persistent::Resource *resource) : type(FN) {
+        payload.object = box(std::move(fn), resource);
+    }
+
+    Form::~Form() {
+        switch (type) {
+            case SPECIAL:
+                release<Special>(payload.object);
+                return;
+            case LIST:
+                release<List>(payload.object);
+                return;
+            case VECTOR:
+                release<Vector>(payload.object);
+                return;
+            case MAP:
+                release<FormWrapperMap>(payload.object);
+                return;
+            case SET:
+                release<FormWrapperSet>(payload.object);
+                return;
+            case FN:
+                release<Fn>(payload.object);
+                return;
+            case TOKEN:
+                break;
+            default:
+                return;
+        }
+        switch (value_kind) {
+            case token::value::STRING:
+                release<std::string>(payload.object);
+                break;
+            case token::value::VIEW:
+                release<std::string_view>(payload.object);
+                break;
+            case token::value::BIG_INT:
+                release<token::value::BigInt>(payload.object);
+                break;
+            case token::value::BIG_DECIMAL:
+                release<token::value::BigDecimal>(payload.object);
+                break;
+            case token::value::RATIO:
+                release<token::value::Ratio>(payload.object);
+                break;
+        }
+    }
+
+    token::Token Form::token() const {
+        token::value::Value value;
+        switch (value_kind) {
+            case token::value::BOOL:
+                value = payload.b;
+                break;
+            case token::value::CHAR:
+                value = payload.c;
+                break;
+            case token::value::LONG:
+                value = payload.l;
+                break;
+            case token::value::DOUBLE:
+                value = payload.d;
+                break;
+            case token::value::STRING:
+                value = std::string_view(get<std::string>(*this));
+                break;
+            case token::value::VIEW:
+                value = get<std::string_view>(*this);
+                break;
+            case token::value::BIG_INT:
+                value = get<token::value::BigInt>(*this);
+                break;
+            case token::value::BIG_DECIMAL:
+                value = get<token::value::BigDecimal>(*this);
+                break;
+            case token::value::RATIO:
+                value = get<token::value::Ratio>(*this);
+                break;
+            case token::value::SYMBOL:
+                value = token::value::Symbol{payload.name};
+                break;
+        }
+        std::uint64_t packed = std::uint64_t(position_high) << 32 | position;
+        return token::Token(value, token_type(), static_cast<int>(packed >> 16), static_cast<int>(packed & 0xffff));
+    }
+
+    std::string_view Form::text() const {
+        switch (value_kind) {
+            case token::value::STRING:
+                return get<std::string>(*this);
+            case token::value::VIEW:
+                return get<std::string_view>(*this);
+        }
+        return payload.name->text;
+    }
     
     template <class T>
-    std::size_t hash(T list) {
+    std::size_t hash(const T & list) {
         std::size_t ret = 0;
-        for (auto item : list) {
+        for (auto & item : list) {
             hash_combine(ret, item);
         }
         return ret;
     }
 
-    std::size_t hash(FormWrapperSet set) {
-        std::vector<std::size_t> hashes;
-        for (auto item : set) {
-            hashes.push_back(hash(item));
-        }
-
-        std::sort(hashes.begin(), hashes.end());
+    // numbers hash to themselves, so the bits of an item's hash
+    // are spread out before it's added to the others
+    std::size_t mix(std::uint64_t hash) {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
 
+    // maps and sets add up the hashes of their items,
+    // so the order they are stored in doesn't matter
+    std::size_t hash(const FormWrapperSet & set) {
         std::size_t ret = 0;
-        for (auto hash : hashes) {
-            hash_combine(ret, hash);
+        for (auto & item : set) {
+            ret += mix(hash(item));
         }
         return ret;
     }
 
-    std::size_t hash(FormWrapperMap map) {
-        std::vector<std::size_t> hashes;
-        for (auto item : map) {
+    std::size_t hash(const FormWrapperMap & map) {
+        std::size_t ret = 0;
+        for (auto & item : map) {
             std::size_t hash = 0;
             hash_combine(hash, item.first, item.second);
-            hashes.push_back(hash);
+            ret += mix(hash);
         }
+        return ret;
+    }
 
-        std::sort(hashes.begin(), hashes.end());
+    // hashes a token the same way std::hash<token::Token> does,
+    // without making the token
+    std::size_t hash_token(const Form & f) {
+        switch (f.value_type()) {
+            case token::value::SYMBOL:
+                return f.token_symbol()->hash;
+            case token::value::STRING:
+            case token::value::VIEW:
+                return std::hash<std::string_view>()(f.text());
+            default:
+                break;
+        }
+        return std::hash<token::value::Value>()(f.token().value);
+    }
 
-        std::size_t ret = 0;
-        for (auto hash : hashes) {
-            hash_combine(ret, hash);
+    // compares tokens the same way token::Token does, without making them
+    bool equals_token(const Form & f1, const Form & f2) {
+        if (f1.token_type() != f2.token_type()) {
+            return false;
         }
-        return ret;
+        auto kind1 = f1.value_type();
+        auto kind2 = f2.value_type();
+        if (kind1 == token::value::SYMBOL && kind2 == token::value::SYMBOL) {
+            return f1.token_symbol() == f2.token_symbol();
+        } else if (token::value::is_text(kind1) && token::value::is_text(kind2)) {
+            return f1.text() == f2.text();
+        } else if (kind1 != kind2) {
+            return false;
+        }
+        switch (kind1) {
+            case token::value::BOOL:
+            case token::value::CHAR:
+            case token::value::LONG:
+            case token::value::DOUBLE:
+                return f1.token().value == f2.token().value;
+            case token::value::BIG_INT:
+                return get<token::value::BigInt>(f1) == get<token::value::BigInt>(f2);
+            case token::value::BIG_DECIMAL:
+                return get<token::value::BigDecimal>(f1) == get<token::value::BigDecimal>(f2);
+            case token::value::RATIO:
+                return get<token::value::Ratio>(f1) == get<token::value::Ratio>(f2);
+            default:
+                break;
+        }
+        return false;
     }
 
     std::size_t hash(const FormWrapper & fw) {
         switch (fw.form.index()) {
             case SPECIAL:
-                return std::hash<form::Special>()(std::get<form::Special>(fw.form));
+                return std::hash<form::Special>()(get<form::Special>(fw.form));
             case TOKEN:
-                return std::hash<token::Token>()(std::get<token::Token>(fw.form));
+                return hash_token(fw.form);
+            case FN:
+                // functions are only ever equal to themselves
+                return std::hash<const Object *>()(fw.form.object());
+            default:
+                break;
+        }
+        // forms aren't changed after they are built, so the hash of a
+        // collection is worked out the first time it's needed and kept
+        auto object = fw.form.object();
+        if (object->hash_code) {
+            return object->hash_code;
+        }
+        switch (fw.form.index()) {
             case LIST:
-                return hash<std::list<FormWrapper>>(std::get<std::list<FormWrapper>>(fw.form));
+                object->hash_code = hash(get<List>(fw.form));
+                break;
             case VECTOR:
-                return hash<std::vector<FormWrapper>>(std::get<std::vector<FormWrapper>>(fw.form));
+                object->hash_code = hash(get<Vector>(fw.form));
+                break;
             case MAP:
-                return hash(*std::get<std::shared_ptr<FormWrapperMap>>(fw.form));
+                object->hash_code = hash(get<FormWrapperMap>(fw.form));
+                break;
             case SET:
-                return hash(*std::get<std::shared_ptr<FormWrapperSet>>(fw.form));
+                object->hash_code = hash(get<FormWrapperSet>(fw.form));
+                break;
+            default:
+                break;
         }
-        return 0;
+        return object->hash_code;
     }
 
+    template <class T1, class T2>
+    bool equals_sequential(const T1 & coll1, const T2 & coll2) {
+        if (coll1.size() != coll2.size()) {
+            return false;
+        }
+        return std::equal(coll1.begin(), coll1.end(), coll2.begin(), coll2.end(),
+            [](const FormWrapper & fw1, const FormWrapper & fw2) { return equals(fw1, fw2); });
+    }
+
+    bool equals(const FormWrapperMap & map1, const FormWrapperMap & map2) {
+        if (map1.size() != map2.size()) {
+            return false;
+        }
+        for (auto & item : map1) {
+            auto value = map2.find(item.first);
+            if (!value || !equals(item.second, *value)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool equals(const FormWrapperSet & set1, const FormWrapperSet & set2) {
+        if (set1.size() != set2.size()) {
+            return false;
+        }
+        for (auto & item : set1) {
+            if (!set2.count(item)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // lists and vectors with equal items are equal to each other,
+    // which matches how they are hashed
     bool equals(const FormWrapper & fw1, const FormWrapper & fw2) {
-        // TODO: equality checking probably shouldn't rely on hashes
-        return hash(fw1) == hash(fw2);
+        if (&fw1 == &fw2) {
+            return true;
+        }
+        auto type1 = fw1.form.index();
+        auto type2 = fw2.form.index();
+        if (type1 == LIST && type2 == VECTOR) {
+            return equals_sequential(get<List>(fw1.form), get<Vector>(fw2.form));
+        } else if (type1 == VECTOR && type2 == LIST) {
+            return equals_sequential(get<Vector>(fw1.form), get<List>(fw2.form));
+        } else if (type1 != type2) {
+            return false;
+        }
+        switch (type1) {
+            case SPECIAL:
+                return get<Special>(fw1.form) == get<Special>(fw2.form);
+            case TOKEN:
+                return equals_token(fw1.form, fw2.form);
+            case LIST:
+                {
+                    auto & list1 = get<List>(fw1.form);
+                    auto & list2 = get<List>(fw2.form);
+                    return list1.identical(list2) || equals_sequential(list1, list2);
+                }
+            case VECTOR:
+                {
+                    auto & vector1 = get<Vector>(fw1.form);
+                    auto & vector2 = get<Vector>(fw2.form);
+                    return vector1.identical(vector2) || equals_sequential(vector1, vector2);
+                }
+            case MAP:
+                {
+                    auto & map1 = get<FormWrapperMap>(fw1.form);
+                    auto & map2 = get<FormWrapperMap>(fw2.form);
+                    return map1.identical(map2) || equals(map1, map2);
+                }
+            case SET:
+                {
+                    auto & set1 = get<FormWrapperSet>(fw1.form);
+                    auto & set2 = get<FormWrapperSet>(fw2.form);
+                    return set1.identical(set2) || equals(set1, set2);
+                }
+            case FN:
+                return fw1.form.object() == fw2.form.object();
+        }
+        return false;
     }
 
     }
@@ -300,64 +1320,85 @@ const std::unordered_map<form::Type, char> TYPE_TO_DELIMITER = {
     {form::SET, '}'}
 };
 
-std::pair<form::Form, std::list<token::Token>::const_iterator> read_form(const std::list<token::Token> *tokens, std::list<token::Token>::const_iterator it);
-std::optional<std::pair<form::Form, std::list<token::Token>::const_iterator> > read_useful_form(const std::list<token::Token> *tokens, std::list<token::Token>::const_iterator it);
-std::optional<std::pair<token::Token, std::list<token::Token>::const_iterator> > read_useful_token(const std::list<token::Token> *tokens, std::list<token::Token>::const_iterator it);
+using Resource = std::pmr::memory_resource;
 
-form::Form list_to_vector(const std::list<form::FormWrapper> list) {
-    return std::vector<form::FormWrapper> {
-        std::make_move_iterator(std::begin(list)),
-        std::make_move_iterator(std::end(list))
-    };
-}
+std::pair<form::Form, token::Tokens::const_iterator> read_form(const token::Tokens *tokens, token::Tokens::const_iterator it, Resource *resource);
+std::optional<std::pair<form::Form, token::Tokens::const_iterator> > read_useful_form(const token::Tokens *tokens, token::Tokens::const_iterator it, Resource *resource);
+std::optional<token::Tokens::const_iterator> read_useful_token(const token::Tokens *tokens, token::Tokens::const_iterator it);
 
-form::Form list_to_map(const std::list<form::FormWrapper> list) {
-    auto m = std::make_shared<form::FormWrapperMap>(form::FormWrapperMap{});
-    form::FormWrapperMap::const_iterator map_it = m->begin();
-    std::list<form::FormWrapper>::const_iterator list_it = list.begin();
-    while (list_it != list.end()) {
-        auto key = *list_it;
-        ++list_it;
-        if (list_it == list.end()) {
-            return form::Special{"ReaderError", "Map must contain even number of forms", std::nullopt};
+// the forms read between a pair of delimiters go straight into
+// a builder for the kind of collection they make up
+
+struct ListBuilder {
+    form::List::Builder list;
+    Resource *resource;
+
+    void add(form::FormWrapper fw) {
+        list.push_back(std::move(fw));
+    }
+
+    form::Form finish() {
+        return form::Form(list.persistent(), resource);
+    }
+};
+
+struct VectorBuilder {
+    form::Vector::Transient vector;
+    Resource *resource;
+
+    void add(form::FormWrapper fw) {
+        vector.push_back(std::move(fw));
+    }
+
+    form::Form finish() {
+        return form::Form(vector.persistent(), resource);
+    }
+};
+
+struct MapBuilder {
+    form::FormWrapperMap::Transient map;
+    std::optional<form::FormWrapper> key;
+    Resource *resource;
+
+    void add(form::FormWrapper fw) {
+        if (key) {
+            map.insert(std::move(*key), std::move(fw));
+            key.reset();
         } else {
-            auto val = *list_it;
-            ++list_it;
-            m->insert(map_it, std::pair(key, val));
+            key = std::move(fw);
         }
     }
-    return m;
-}
 
-form::Form list_to_set(const std::list<form::FormWrapper> list) {
-    auto s = std::make_shared<form::FormWrapperSet>(form::FormWrapperSet{});
-    form::FormWrapperSet::const_iterator it = s->begin();
-    for (auto item : list) {
-        s->insert(it, item);
+    form::Form finish() {
+        if (key) {
+            return form::Special{"ReaderError", "Map must contain even number of forms", std::nullopt};
+        }
+        return form::Form(map.persistent(), resource);
     }
-    return s;
-}
+};
 
-std::pair<form::Form, std::list<token::Token>::const_iterator> read_coll(const std::list<token::Token> *tokens, std::list<token::Token>::const_iterator it, form::Type form_type) {
-    char end_delimiter = TYPE_TO_DELIMITER.at(form_type);
-    std::list<form::FormWrapper> forms;
-    while (auto ret_opt = read_useful_token(tokens, it)) {
-        auto ret = ret_opt.value();
-        auto token = ret.first;
-        it = ret.second;
+struct SetBuilder {
+    form::FormWrapperSet::Transient set;
+    Resource *resource;
+
+    void add(form::FormWrapper fw) {
+        set.insert(std::move(fw));
+    }
+
+    form::Form finish() {
+        return form::Form(set.persistent(), resource);
+    }
+};
+
+template <class Builder>
+std::pair<form::Form, token::Tokens::const_iterator> read_coll(const token::Tokens *tokens, token::Tokens::const_iterator it, char end_delimiter, Builder builder, Resource *resource) {
+    while (auto it_opt = read_useful_token(tokens, it)) {
+        it = it_opt.value();
+        const auto & token = *it;
         if (token.type == token::type::SPECIAL_CHAR) {
             char c = std::get<char>(token.value);
             if (c == end_delimiter) {
-                switch (form_type) {
-                    case form::VECTOR:
-                        return std::make_pair(list_to_vector(forms), ++it);
-                    case form::MAP:
-                        return std::make_pair(list_to_map(forms), ++it);
-                    case form::SET:
-                        return std::make_pair(list_to_set(forms), ++it);
-                    default:
-                        return std::make_pair(forms, ++it);
-                }
+                return std::make_pair(builder.finish(), ++it);
             } else {
                 switch (c) {
                     case ')':
@@ -367,37 +1408,49 @@ std::pair<form::Form, std::list<token::Token>::const_iterator> read_coll(const s
                 }
             }
         }
-        auto ret2 = read_form(tokens, it);
-        forms.push_back(form::FormWrapper{ret2.first});
+        auto ret2 = read_form(tokens, it, resource);
+        builder.add(form::FormWrapper{std::move(ret2.first)});
         it = ret2.second;
     }
     return std::make_pair(form::Special{"ReaderError", "EOF: no " + std::string(1, end_delimiter) + " found", std::nullopt}, tokens->end());
 }
 
-std::pair<form::Form, std::list<token::Token>::const_iterator> expand_quoted_form(const std::list<token::Token> *tokens, std::list<token::Token>::const_iterator it, token::Token token) {
-    if (auto ret_opt = read_useful_form(tokens, it)) {
-        auto ret = ret_opt.value();
-        std::list<form::FormWrapper> list {
-            form::FormWrapper{token},
-            ret.first
-        };
-        return std::make_pair(list, ret.second);
+std::pair<form::Form, token::Tokens::const_iterator> read_coll(const token::Tokens *tokens, token::Tokens::const_iterator it, form::Type form_type, Resource *resource) {
+    char end_delimiter = TYPE_TO_DELIMITER.at(form_type);
+    switch (form_type) {
+        case form::VECTOR:
+            return read_coll(tokens, it, end_delimiter, VectorBuilder{form::Vector().transient(resource), resource}, resource);
+        case form::MAP:
+            return read_coll(tokens, it, end_delimiter, MapBuilder{form::FormWrapperMap().transient(resource), std::nullopt, resource}, resource);
+        case form::SET:
+            return read_coll(tokens, it, end_delimiter, SetBuilder{form::FormWrapperSet().transient(resource), resource}, resource);
+        default:
+            return read_coll(tokens, it, end_delimiter, ListBuilder{form::List::Builder(resource), resource}, resource);
+    }
+}
+
+std::pair<form::Form, token::Tokens::const_iterator> expand_quoted_form(const token::Tokens *tokens, token::Tokens::const_iterator it, token::Token token, Resource *resource) {
+    if (auto ret_opt = read_useful_form(tokens, it, resource)) {
+        auto & ret = ret_opt.value();
+        form::List::Builder list(resource);
+        list.push_back(form::FormWrapper{form::Form(std::move(token), resource)});
+        list.push_back(form::FormWrapper{std::move(ret.first)});
+        return std::make_pair(form::Form(list.persistent(), resource), ret.second);
     } else {
         return std::make_pair(form::Special{"ReaderError", "EOF: Nothing found after quote", token}, tokens->end());
     }
 }
 
-std::pair<form::Form, std::list<token::Token>::const_iterator> expand_meta_quoted_form(const std::list<token::Token> *tokens, std::list<token::Token>::const_iterator it, token::Token token) {
-    if (auto ret_opt = read_useful_form(tokens, it)) {
-        auto ret = ret_opt.value();
-        if (auto ret_opt2 = read_useful_form(tokens, ret.second)) {
-            auto ret2 = ret_opt2.value();
-            std::list<form::FormWrapper> list {
-                form::FormWrapper{token},
-                ret2.first,
-                ret.first
-            };
-            return std::make_pair(list, ret2.second);
+std::pair<form::Form, token::Tokens::const_iterator> expand_meta_quoted_form(const token::Tokens *tokens, token::Tokens::const_iterator it, token::Token token, Resource *resource) {
+    if (auto ret_opt = read_useful_form(tokens, it, resource)) {
+        auto & ret = ret_opt.value();
+        if (auto ret_opt2 = read_useful_form(tokens, ret.second, resource)) {
+            auto & ret2 = ret_opt2.value();
+            form::List::Builder list(resource);
+            list.push_back(form::FormWrapper{form::Form(std::move(token), resource)});
+            list.push_back(form::FormWrapper{std::move(ret2.first)});
+            list.push_back(form::FormWrapper{std::move(ret.first)});
+            return std::make_pair(form::Form(list.persistent(), resource), ret2.second);
         } else {
             return std::make_pair(form::Special{"ReaderError", "EOF: Nothing found after metadata", token}, tokens->end());
         }
@@ -406,16 +1459,30 @@ std::pair<form::Form, std::list<token::Token>::const_iterator> expand_meta_quote
     }
 }
 
-std::pair<form::Form, std::list<token::Token>::const_iterator> read_form(const std::list<token::Token> *tokens, std::list<token::Token>::const_iterator it) {
-    auto token = *it;
+std::string unescape(std::string_view s) {
+    std::string ret;
+    ret.reserve(s.size());
+    for (std::size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '\\' && i + 1 < s.size()) {
+            ++i;
+            ret += s[i] == 'n' ? '\n' : s[i];
+        } else {
+            ret += s[i];
+        }
+    }
+    return ret;
+}
+
+std::pair<form::Form, token::Tokens::const_iterator> read_form(const token::Tokens *tokens, token::Tokens::const_iterator it, Resource *resource) {
+    const auto & token = *it;
     switch (token.type) {
         case token::type::SPECIAL_CHARS:
             {
-                std::string s = std::get<std::string>(token.value);
+                std::string s(token::value::text(token.value));
                 if (s == "#{") {
-                    return read_coll(tokens, ++it, DELIMITER_TO_TYPE.at(s));
+                    return read_coll(tokens, ++it, DELIMITER_TO_TYPE.at(s), resource);
                 } else if (s == "~@") {
-                    return expand_quoted_form(tokens, ++it, token::Token{SYMBOL_TO_NAME.at(s), token::type::SYMBOL, token.line, token.column});
+                    return expand_quoted_form(tokens, ++it, token::Token{token::value::intern(SYMBOL_TO_NAME.at(s)), token::type::SYMBOL, token.line, token.column}, resource);
                 }
                 break;
             }
@@ -426,7 +1493,7 @@ std::pair<form::Form, std::list<token::Token>::const_iterator> read_form(const s
                     case '(':
                     case '[':
                     case '{':
-                        return read_coll(tokens, ++it, DELIMITER_TO_TYPE.at(c));
+                        return read_coll(tokens, ++it, DELIMITER_TO_TYPE.at(c), resource);
                     case ')':
                     case ']':
                     case '}':
@@ -435,65 +1502,567 @@ std::pair<form::Form, std::list<token::Token>::const_iterator> read_form(const s
                     case '`':
                     case '~':
                     case '@':
-                        return expand_quoted_form(tokens, ++it, token::Token{SYMBOL_TO_NAME.at(c), token::type::SYMBOL, token.line, token.column});
+                        return expand_quoted_form(tokens, ++it, token::Token{token::value::intern(SYMBOL_TO_NAME.at(c)), token::type::SYMBOL, token.line, token.column}, resource);
                     case '^':
-                        return expand_meta_quoted_form(tokens, ++it, token::Token{SYMBOL_TO_NAME.at(c), token::type::SYMBOL, token.line, token.column});
+                        return expand_meta_quoted_form(tokens, ++it, token::Token{token::value::intern(SYMBOL_TO_NAME.at(c)), token::type::SYMBOL, token.line, token.column}, resource);
                 }
                 break;
             }
+        case token::type::NUMBER:
+            if (token::value::is_text(token.value)) {
+                return std::make_pair(form::Special{"ReaderError", "Invalid number: " + std::string(token::value::text(token.value)), token}, tokens->end());
+            }
+            break;
         case token::type::STRING:
             {
-                std::string s = std::get<std::string>(token.value);
+                auto s = token::value::text(token.value);
                 if (s.size() < 2 || s.back() != '"') {
                     return std::make_pair(form::Special{"ReaderError", "EOF: unbalanced quote", token}, tokens->end());
+                }
+                s = s.substr(1, s.size() - 2);
+                token::value::Value value;
+                if (s.find('\\') != std::string_view::npos) {
+                    value = unescape(s);
+                } else if (token.value.index() == token::value::VIEW) {
+                    value = s;
                 } else {
-                    token.value = s.substr(1, s.size() - 2);
+                    value = std::string(s);
                 }
-                break;
+                return std::make_pair(form::Form(token::Token{value, token.type, token.line, token.column}, resource), ++it);
             }
     }
-    return std::make_pair(token, ++it);
+    return std::make_pair(form::Form(token, resource), ++it);
 }
 
-std::optional<std::pair<token::Token, std::list<token::Token>::const_iterator> > read_useful_token(const std::list<token::Token> *tokens, std::list<token::Token>::const_iterator it) {
+std::optional<token::Tokens::const_iterator> read_useful_token(const token::Tokens *tokens, token::Tokens::const_iterator it) {
     while (it != tokens->end()) {
-        auto token = *it;
-        switch (token.type) {
+        switch (it->type) {
             case token::type::WHITESPACE:
             case token::type::COMMENT:
                 ++it;
                 break;
             default:
-                return std::make_pair(token, it);
+                return it;
         }
     }
     return std::nullopt;
 }
 
-std::optional<std::pair<form::Form, std::list<token::Token>::const_iterator> > read_useful_form(const std::list<token::Token> *tokens, std::list<token::Token>::const_iterator it) {
-    if (auto ret_opt = read_useful_token(tokens, it)) {
-        auto ret = ret_opt.value();
-        return read_form(tokens, ret.second);
+std::optional<std::pair<form::Form, token::Tokens::const_iterator> > read_useful_form(const token::Tokens *tokens, token::Tokens::const_iterator it, Resource *resource) {
+    if (auto it_opt = read_useful_token(tokens, it)) {
+        return read_form(tokens, it_opt.value(), resource);
     } else {
         return std::nullopt;
     }
 }
 
-std::list<form::Form> read_forms(const std::list<token::Token> *tokens) {
+std::list<form::Form> read_forms(const token::Tokens *tokens, Resource *resource = std::pmr::get_default_resource()) {
     std::list<form::Form> forms;
-    std::list<token::Token>::const_iterator it = tokens->begin();
-    while (auto ret_opt = read_useful_form(tokens, it)) {
-        auto ret = ret_opt.value();
-        forms.push_back(ret.first);
+    token::Tokens::const_iterator it = tokens->begin();
+    while (auto ret_opt = read_useful_form(tokens, it, resource)) {
+        auto & ret = ret_opt.value();
+        forms.push_back(std::move(ret.first));
         it = ret.second;
     }
     return forms;
 }
 
-std::list<form::Form> read(const std::string input) {
+std::list<form::Form> read(const std::string & input) {
     auto tokens = token::tokenize(input);
     auto forms = read_forms(&tokens);
     return forms;
 }
 
+// like read, but symbols and strings without escapes are slices
+// of the input rather than copies, so the input must outlive the forms
+std::list<form::Form> read_view(std::string_view input) {
+    auto tokens = token::tokenize(input, true);
+    auto forms = read_forms(&tokens);
+    return forms;
+}
+
+// like read (or read_view, if view is true), but allocates every collection
+// from the given resource. with a std::pmr::monotonic_buffer_resource the
+// whole tree comes out of a few large blocks, and is freed all at once
+// along with the resource, so the forms must not outlive it.
+std::list<form::Form> read(std::string_view input, Resource *resource, bool view = false) {
+    auto tokens = token::tokenize(input, view);
+    auto forms = read_forms(&tokens, resource);
+    return forms;
+}
+
+// follows the nesting of tokens to find where top-level forms end
+struct FormTracker {
+    // the nesting depth, and how many more forms at depth 0
+    // are needed to finish the top-level form
+    int depth = 0;
+    int remaining = 1;
+
+    // returns true if the token finishes the top-level form,
+    // after which the tracker should be reset
+    bool completes(token::type::Type type, std::string_view text) {
+        switch (type) {
+            case token::type::WHITESPACE:
+            case token::type::COMMENT:
+                return false;
+            case token::type::SPECIAL_CHARS:
+                if (text == "#{") {
+                    ++depth;
+                }
+                return false;
+            case token::type::SPECIAL_CHAR:
+                switch (text[0]) {
+                    case '(':
+                    case '[':
+                    case '{':
+                        ++depth;
+                        return false;
+                    case ')':
+                    case ']':
+                    case '}':
+                        if (depth == 0) {
+                            // unmatched delimiter, which ends the form with an error
+                            remaining = 0;
+                            return true;
+                        }
+                        --depth;
+                        break;
+                    case '^':
+                        // needs both the metadata and the form it applies to
+                        if (depth == 0) {
+                            ++remaining;
+                        }
+                        return false;
+                    default:
+                        // quote characters need exactly one form after them
+                        return false;
+                }
+                break;
+            default:
+                break;
+        }
+        if (depth == 0) {
+            --remaining;
+        }
+        return remaining == 0;
+    }
+};
+
+bool has_reader_error(const form::Form & form) {
+    switch (form.index()) {
+        case form::SPECIAL:
+            return form::get<form::Special>(form).name == "ReaderError";
+        case form::LIST:
+            for (auto & item : form::get<form::List>(form)) {
+                if (has_reader_error(item.form)) {
+                    return true;
+                }
+            }
+            break;
+        case form::VECTOR:
+            for (auto & item : form::get<form::Vector>(form)) {
+                if (has_reader_error(item.form)) {
+                    return true;
+                }
+            }
+            break;
+        case form::MAP:
+            for (auto & item : form::get<form::FormWrapperMap>(form)) {
+                if (has_reader_error(item.first.form) || has_reader_error(item.second.form)) {
+                    return true;
+                }
+            }
+            break;
+        case form::SET:
+            for (auto & item : form::get<form::FormWrapperSet>(form)) {
+                if (has_reader_error(item.form)) {
+                    return true;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    return false;
+}
+
+// a piece of the input that starts and ends between top-level forms
+struct Piece {
+    std::size_t start;
+    std::size_t end;
+    int line;
+    int column;
+};
+
+// calls work with each index below count, on up to threads threads
+template <class Work>
+void for_each_parallel(std::size_t count, unsigned threads, Work work) {
+    std::atomic<std::size_t> next{0};
+    auto run = [&] {
+        for (std::size_t i = next++; i < count; i = next++) {
+            work(i);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < std::min<std::size_t>(threads, count); ++i) {
+        pool.emplace_back(run);
+    }
+    run();
+    for (auto & thread : pool) {
+        thread.join();
+    }
+}
+
+// splits the input into roughly equal pieces without splitting any
+// top-level form, by scanning all of its tokens without building them
+std::vector<Piece> split_forms_serially(std::string_view input, std::size_t count) {
+    std::vector<Piece> pieces;
+    FormTracker tracker;
+    std::size_t start = 0;
+    int start_line = 1;
+    int start_column = 1;
+    int line = 1;
+    std::size_t line_start = 0;
+    std::size_t pos = 0;
+    while (pos < input.size()) {
+        token::type::Type type;
+        std::size_t end = token::scan(input, pos, type);
+        std::string_view value_str = input.substr(pos, end - pos);
+        token::count_lines(type, value_str, pos, line, line_start);
+        pos = end;
+        if (tracker.completes(type, value_str)) {
+            tracker = FormTracker{};
+            if (pieces.size() + 1 < count && pos >= input.size() * (pieces.size() + 1) / count) {
+                pieces.push_back(Piece{start, pos, start_line, start_column});
+                start = pos;
+                start_line = line;
+                start_column = static_cast<int>(pos - line_start + 1);
+            }
+        }
+    }
+    pieces.push_back(Piece{start, input.size(), start_line, start_column});
+    return pieces;
+}
+
+// what scanning the tokens from one guessed start of a piece to the next found
+struct Stretch {
+    // how many lines it went past, and where the last of them ended
+    int lines = 0;
+    std::size_t line_start = 0;
+    // whether a token ended exactly at the next start, between top-level forms
+    bool lands = false;
+};
+
+Stretch scan_stretch(std::string_view input, std::size_t start, std::size_t end) {
+    Stretch stretch;
+    FormTracker tracker;
+    bool between = true;
+    std::size_t pos = start;
+    while (pos < end) {
+        token::type::Type type;
+        std::size_t next = token::scan(input, pos, type);
+        std::string_view value_str = input.substr(pos, next - pos);
+        token::count_lines(type, value_str, pos, stretch.lines, stretch.line_start);
+        pos = next;
+        if (tracker.completes(type, value_str)) {
+            tracker = FormTracker{};
+            between = true;
+        } else if (type != token::type::WHITESPACE && type != token::type::COMMENT) {
+            between = false;
+        }
+    }
+    stretch.lands = pos == end && between;
+    return stretch;
+}
+
+// splits the input into roughly equal pieces without splitting any
+// top-level form. scanning the tokens to find where forms end takes
+// about a twentieth of the time reading them does, so rather than
+// scanning the whole input before reading any of it, each piece is
+// guessed to start at the first line after its share of the input that
+// doesn't start with whitespace, and the guesses are checked by scanning
+// the pieces on threads, each from the start of its own to the start of
+// the next. since the first piece starts at the start of the input, if
+// every scan ends exactly on the next start between top-level forms then
+// every start is right. when one doesn't, say because a string or form
+// has lines that start in the first column, the whole input is scanned
+// on this thread instead, which costs that scan again on top of the one
+// piece's worth of scanning that was wasted
+std::vector<Piece> split_forms(std::string_view input, std::size_t count, unsigned threads = std::thread::hardware_concurrency()) {
+    std::vector<std::size_t> starts{0};
+    for (std::size_t i = 1; i < count; ++i) {
+        std::size_t pos = std::max(input.size() * i / count, starts.back() + 1);
+        for (pos = input.find('\n', pos - 1); pos < input.size(); pos = input.find('\n', pos + 1)) {
+            if (pos + 1 < input.size() && !token::chars::is(input[pos + 1], token::chars::WHITESPACE)) {
+                break;
+            }
+        }
+        if (pos >= input.size()) {
+            break;
+        }
+        starts.push_back(pos + 1);
+    }
+    if (starts.size() < 2) {
+        return split_forms_serially(input, count);
+    }
+    starts.push_back(input.size());
+
+    std::vector<Stretch> stretches(starts.size() - 1);
+    for_each_parallel(stretches.size(), std::max(threads, 1u), [&](std::size_t i) {
+        stretches[i] = scan_stretch(input, starts[i], starts[i + 1]);
+    });
+
+    std::vector<Piece> pieces;
+    int line = 1;
+    int column = 1;
+    for (std::size_t i = 0; i < stretches.size(); ++i) {
+        auto & stretch = stretches[i];
+        if (i + 1 < stretches.size() && !stretch.lands) {
+            return split_forms_serially(input, count);
+        }
+        pieces.push_back(Piece{starts[i], starts[i + 1], line, column});
+        if (stretch.lines > 0) {
+            line += stretch.lines;
+            column = static_cast<int>(starts[i + 1] - stretch.line_start + 1);
+        } else {
+            column += static_cast<int>(starts[i + 1] - starts[i]);
+        }
+    }
+    return pieces;
+}
+
+// returns the same forms as read (or read_view, if view is true), but
+// reads pieces of the input on a pool of threads
+std::list<form::Form> read_parallel(std::string_view input, bool view = false, unsigned threads = std::thread::hardware_concurrency()) {
+    threads = std::max(threads, 1u);
+    // more pieces than threads so a slow piece doesn't hold up the rest
+    auto pieces = split_forms(input, threads * 4, threads);
+    std::vector<std::list<form::Form>> results(pieces.size());
+    std::vector<char> errors(pieces.size(), false);
+
+    for_each_parallel(pieces.size(), threads, [&](std::size_t i) {
+        auto & piece = pieces[i];
+        auto tokens = token::tokenize(input.substr(piece.start, piece.end - piece.start), view, piece.line, piece.column);
+        results[i] = read_forms(&tokens);
+        errors[i] = std::any_of(results[i].begin(), results[i].end(), has_reader_error);
+    });
+
+    std::list<form::Form> forms;
+    for (std::size_t i = 0; i < pieces.size(); ++i) {
+        if (errors[i]) {
+            // a reader error can make read skip the rest of the input,
+            // so read everything from here on serially instead
+            auto tokens = token::tokenize(input.substr(pieces[i].start), view, pieces[i].line, pieces[i].column);
+            forms.splice(forms.end(), read_forms(&tokens));
+            break;
+        }
+        forms.splice(forms.end(), results[i]);
+    }
+    return forms;
+}
+
+// reads one top-level form at a time from a stream, only keeping
+// the tokens of the form being read and the current chunk in memory.
+// for well-formed input it returns the same forms as read, but a
+// reader error only ends the form it occurs in rather than the input.
+class Reader {
+public:
+    // fills the buffer it is given and returns how much it wrote,
+    // returning 0 only at the end of the input
+    using Source = std::function<std::size_t(char *, std::size_t)>;
+
+    Reader(Source s, std::size_t size = 64 * 1024) : source(s), chunk_size(size) {}
+
+    Reader(std::istream & in, std::size_t size = 64 * 1024) : Reader([&in](char *buf, std::size_t n) {
+        in.read(buf, n);
+        return static_cast<std::size_t>(in.gcount());
+    }, size) {}
+
+#if __has_include(<unistd.h>)
+    Reader(int fd, std::size_t size = 64 * 1024) : Reader([fd](char *buf, std::size_t n) {
+        ssize_t ret;
+        do {
+            ret = ::read(fd, buf, n);
+        } while (ret < 0 && errno == EINTR);
+        return static_cast<std::size_t>(ret > 0 ? ret : 0);
+    }, size) {}
+#endif
+
+    // returns the next top-level form, or nothing at the end of the input
+    std::optional<form::Form> next() {
+        while (true) {
+            while (pos < buffer.size()) {
+                token::type::Type type;
+                std::size_t end = token::scan(buffer, pos, type);
+                // the token may continue in the next chunk, which includes a
+                // string stopping at a backslash that could start an escape
+                // and a number stopping at a partial exponent, ratio or hex prefix
+                std::string_view rest = std::string_view(buffer).substr(end);
+                if (!eof && (end == buffer.size() ||
+                             (type == token::type::STRING && end + 1 == buffer.size()) ||
+                             (type == token::type::NUMBER && rest.size() <= 2 &&
+                              token::number_may_continue(std::string_view(buffer).substr(pos, end - pos), rest)))) {
+                    break;
+                }
+                std::string_view value_str = std::string_view(buffer).substr(pos, end - pos);
+                // columns are counted from the start of the line, so they only
+                // get as big as the longest line rather than the whole input
+                std::size_t column = offset + pos - line_start + 1;
+                tokens.push_back(token::Token{token::parse(value_str, type), type, line,
+                                              static_cast<int>(std::min<std::size_t>(column, std::numeric_limits<int>::max()))});
+                token::count_lines(type, value_str, offset + pos, line, line_start);
+                pos = end;
+                if (tracker.completes(type, value_str)) {
+                    return take_form();
+                }
+            }
+            if (eof) {
+                return take_form();
+            }
+            fill();
+        }
+    }
+
+private:
+    Source source;
+    std::size_t chunk_size;
+    std::string buffer;
+    // where the next token starts in the buffer
+    std::size_t pos = 0;
+    // how much input was dropped from the front of the buffer
+    std::size_t offset = 0;
+    int line = 1;
+    // where the line the next token is on starts in the input
+    std::size_t line_start = 0;
+    bool eof = false;
+    token::Tokens tokens;
+    FormTracker tracker;
+
+    void fill() {
+        // everything before pos has already been tokenized
+        buffer.erase(0, pos);
+        offset += pos;
+        pos = 0;
+        std::size_t size = buffer.size();
+        buffer.resize(size + chunk_size);
+        std::size_t n = source(buffer.data() + size, chunk_size);
+        buffer.resize(size + n);
+        if (n == 0) {
+            eof = true;
+        }
+    }
+
+    std::optional<form::Form> take_form() {
+        auto forms = read_forms(&tokens);
+        tokens.clear();
+        tracker = FormTracker{};
+        if (forms.empty()) {
+            return std::nullopt;
+        }
+        return forms.front();
+    }
+};
+
+// the contents of a whole file, which is mapped into memory when
+// possible so it doesn't need to be copied and the page cache can be
+// shared with other processes reading it
+class File {
+public:
+    File(const std::string & path) {
+#if __has_include(<sys/mman.h>)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        opened = true;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void *p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                ::madvise(p, st.st_size, MADV_SEQUENTIAL);
+                data = static_cast<const char *>(p);
+                size = st.st_size;
+                mapped = true;
+                ::close(fd);
+                return;
+            }
+        }
+        // pipes, devices and empty files can't be mapped, so read them instead
+        char chunk[64 * 1024];
+        ssize_t n;
+        while ((n = ::read(fd, chunk, sizeof(chunk))) != 0) {
+            if (n > 0) {
+                buffer.append(chunk, n);
+            } else if (errno != EINTR) {
+                failed = true;
+                break;
+            }
+        }
+        ::close(fd);
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            return;
+        }
+        opened = true;
+        std::stringstream ss;
+        ss << in.rdbuf();
+        failed = in.bad();
+        buffer = ss.str();
+#endif
+        data = buffer.data();
+        size = buffer.size();
+    }
+
+    File(const File &) = delete;
+    File & operator=(const File &) = delete;
+
+    ~File() {
+#if __has_include(<sys/mman.h>)
+        if (mapped) {
+            ::munmap(const_cast<char *>(data), size);
+        }
+#endif
+    }
+
+    bool is_open() const {
+        return opened;
+    }
+
+    // whether reading stopped on an error, leaving only part of the file
+    bool has_failed() const {
+        return failed;
+    }
+
+    std::string_view view() const {
+        return std::string_view(data, size);
+    }
+
+private:
+    const char *data = nullptr;
+    std::size_t size = 0;
+    bool opened = false;
+    bool failed = false;
+    bool mapped = false;
+    std::string buffer;
+};
+
+// forms read from a file by read_file. their symbols and strings may be
+// slices of the file, so they are only valid as long as it is kept.
+struct FileForms {
+    std::shared_ptr<const File> file;
+    std::list<form::Form> forms;
+};
+
+FileForms read_file(const std::string & path) {
+    auto file = std::make_shared<const File>(path);
+    if (!file->is_open()) {
+        return FileForms{file, {form::Special{"ReaderError", "Could not open file: " + path, std::nullopt}}};
+    }
+    if (file->has_failed()) {
+        return FileForms{file, {form::Special{"ReaderError", "Could not read file: " + path, std::nullopt}}};
+    }
+    return FileForms{file, read_view(file->view())};
+}
+
 }
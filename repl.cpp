@@ -3,15 +3,22 @@
 
 #include "read.hpp"
 #include "eval.hpp"
+#include "vm.hpp"
 #include "print.hpp"
 
+// forms are run on the bytecode evaluator, or the tree walker with --tree
 int main(int argc, char* argv[]) {
+    auto evaluator = zachlisp::Evaluator::BYTECODE;
+    if (argc > 1 && std::string(argv[1]) == "--tree") {
+        evaluator = zachlisp::Evaluator::TREE_WALKER;
+    }
     chaiscript::ChaiScript chai;
+    zachlisp::native::Runtime runtime(&chai);
     std::string input;
     do {
         std::cout << "user> ";
         std::getline(std::cin, input);
-        std::cout << zachlisp::print(zachlisp::eval(zachlisp::read(input), &chai));
+        std::cout << zachlisp::print(zachlisp::eval(zachlisp::read(input), runtime, evaluator));
     } while (!std::cin.fail());
     return 0;
 }
@@ -0,0 +1,675 @@
+#pragma once
+
+#include <cstdint>
+
+#include "eval.hpp"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ZACHLISP_COMPUTED_GOTO
+#endif
+
+namespace zachlisp {
+
+    // the bytecode evaluator. the trees the native evaluator analyzes forms
+    // into are compiled into instructions on registers, which live in one
+    // vector shared by every call. locals are kept in registers too, and
+    // closures capture their values, so calling a function allocates nothing.
+    namespace vm {
+
+    using native::Expr;
+    using native::Global;
+    using native::EnvPtr;
+
+    enum Op : std::uint8_t {
+        CONST,       // a = constants[b]
+        MOVE,        // a = b
+        CAPTURED,    // a = the value b the function's closure captured
+        CELL,        // a = a new cell
+        LOAD_CELL,   // a = the value in the cell in b
+        STORE_CELL,  // the value in the cell in a = b
+        GLOBAL,      // a = globals[b]
+        DEF,         // globals[a] = b
+        JUMP,        // go to a
+        JUMP_IF_NOT, // go to b if a isn't truthy
+        CALL,        // a = b(the c registers after b)
+        TAIL_CALL,   // return a(the b registers after a)
+        RETURN,      // return a
+        CLOSURE,     // a = a closure of protos[b], capturing what it uses
+        VECTOR,      // a = [the c registers from b]
+        MAP,         // a = {the c registers from b}
+        SET,         // a = #{the c registers from b}
+        // a = operators[c](b, b + 1), worked out here for two longs
+        // if the operator is still the builtin it was compiled against
+        ADD,
+        SUB,
+        MUL,
+        LT,
+        LE,
+        GT,
+        GE,
+        EQ
+    };
+
+    struct Instruction {
+        Op op;
+        std::uint32_t a;
+        std::uint32_t b;
+        std::uint32_t c;
+    };
+
+    struct Operator {
+        Global *global;
+        // holds on to the builtin so its address can't be reused by
+        // whatever the global is set to after it
+        form::Form builtin;
+    };
+
+    // a compiled function, or top-level form
+    struct Proto {
+        std::vector<Instruction> code;
+        std::vector<form::Form> constants;
+        std::vector<Global *> globals;
+        std::vector<Operator> operators;
+        std::vector<std::shared_ptr<const Proto>> protos;
+        std::size_t params = 0;
+        bool variadic = false;
+        std::size_t frame_size = 0;
+        std::size_t registers = 0;
+        std::vector<native::Slot> captures;
+        // the register the function's own closure goes in, if it uses it
+        std::optional<std::size_t> self;
+    };
+
+    using ProtoPtr = std::shared_ptr<const Proto>;
+
+    struct Bytecode : native::Function {
+        ProtoPtr proto;
+        EnvPtr env;
+
+        Bytecode(ProtoPtr p, EnvPtr e) : Function(BYTECODE), proto(std::move(p)), env(std::move(e)) {}
+
+        form::Form call(const form::Form & self, form::Form *args, std::size_t count, native::Runtime & runtime) const override;
+
+        const EnvPtr * captured() const override {
+            return &env;
+        }
+    };
+
+    const std::unordered_map<std::string_view, Op> OPERATORS = {
+        {"+", ADD}, {"-", SUB}, {"*", MUL}, {"<", LT}, {"<=", LE}, {">", GT}, {">=", GE}, {"=", EQ}
+    };
+
+    class Compiler {
+    public:
+        // compiles the body of a function with the given parameters
+        static ProtoPtr compile(const Expr & body, std::size_t params, bool variadic, std::size_t frame_size, std::vector<native::Slot> captures = {},
+                                std::optional<std::size_t> self = std::nullopt) {
+            auto proto = std::make_shared<Proto>();
+            proto->params = params;
+            proto->variadic = variadic;
+            proto->frame_size = frame_size;
+            proto->captures = std::move(captures);
+            proto->self = self;
+            Compiler compiler(*proto);
+            compiler.compile_tail(body);
+            proto->registers = compiler.max_registers;
+            return proto;
+        }
+
+    private:
+        Proto & proto;
+        // the first free register, and the most that have been used
+        std::uint32_t next;
+        std::uint32_t max_registers;
+
+        // the first registers are the frame
+        Compiler(Proto & p) : proto(p), next(p.frame_size), max_registers(p.frame_size) {}
+
+        std::uint32_t allocate(std::uint32_t count = 1) {
+            auto ret = next;
+            next += count;
+            max_registers = std::max(max_registers, next);
+            return ret;
+        }
+
+        std::size_t emit(Op op, std::uint32_t a = 0, std::uint32_t b = 0, std::uint32_t c = 0) {
+            proto.code.push_back(Instruction{op, a, b, c});
+            return proto.code.size() - 1;
+        }
+
+        std::uint32_t here() const {
+            return proto.code.size();
+        }
+
+        template <class T>
+        static std::uint32_t index_of(std::vector<T> & items, T item) {
+            auto it = std::find(items.begin(), items.end(), item);
+            if (it != items.end()) {
+                return it - items.begin();
+            }
+            items.push_back(std::move(item));
+            return items.size() - 1;
+        }
+
+        std::uint32_t constant(const form::Form & value) {
+            proto.constants.push_back(value);
+            return proto.constants.size() - 1;
+        }
+
+        static bool in_register(const Expr & expr) {
+            return expr.kind == native::LOCAL && expr.slot.depth == 0 && !expr.slot.cell;
+        }
+
+        // the register holding the value of expr, which is only
+        // worked out into a new one if it isn't a local already there
+        std::uint32_t operand(const Expr & expr) {
+            if (in_register(expr)) {
+                return expr.slot.index;
+            }
+            auto reg = allocate();
+            compile(expr, reg);
+            return reg;
+        }
+
+        // compiles exprs into count registers in a row, starting at the returned one
+        std::uint32_t compile_all(const native::Exprs & exprs, std::size_t from) {
+            auto first = allocate(exprs.size() - from);
+            for (auto i = from; i < exprs.size(); ++i) {
+                auto saved = next;
+                compile(*exprs[i], first + i - from);
+                next = saved;
+            }
+            return first;
+        }
+
+        // the operator a call is of, if it's one that has an instruction
+        std::optional<Op> operator_of(const Expr & expr) const {
+            if (expr.children.size() != 3 || expr.children[0]->kind != native::GLOBAL) {
+                return std::nullopt;
+            }
+            auto global = expr.children[0]->global;
+            auto it = OPERATORS.find(global->name->text);
+            if (it == OPERATORS.end() || !global->value || global->value->index() != form::FN
+                || native::function(*global->value).kind != native::Function::BUILTIN) {
+                return std::nullopt;
+            }
+            return it->second;
+        }
+
+        void compile(const Expr & expr, std::uint32_t dst) {
+            auto saved = next;
+            switch (expr.kind) {
+                case native::CONSTANT:
+                    emit(CONST, dst, constant(expr.value));
+                    break;
+                case native::LOCAL:
+                    if (in_register(expr)) {
+                        if (dst != expr.slot.index) {
+                            emit(MOVE, dst, expr.slot.index);
+                        }
+                    } else if (expr.slot.depth == 0) {
+                        emit(LOAD_CELL, dst, expr.slot.index);
+                    } else {
+                        emit(CAPTURED, dst, expr.slot.index);
+                        if (expr.slot.cell) {
+                            emit(LOAD_CELL, dst, dst);
+                        }
+                    }
+                    break;
+                case native::GLOBAL:
+                    emit(GLOBAL, dst, index_of(proto.globals, expr.global));
+                    break;
+                case native::IF:
+                    {
+                        auto test = operand(*expr.children[0]);
+                        auto jump_else = emit(JUMP_IF_NOT, test);
+                        next = saved;
+                        compile(*expr.children[1], dst);
+                        auto jump_end = emit(JUMP);
+                        proto.code[jump_else].b = here();
+                        if (expr.children.size() == 3) {
+                            compile(*expr.children[2], dst);
+                        } else {
+                            emit(CONST, dst, constant(native::nil()));
+                        }
+                        proto.code[jump_end].a = here();
+                    }
+                    break;
+                case native::DO:
+                    for (std::size_t i = 0; i + 1 < expr.children.size(); ++i) {
+                        compile(*expr.children[i], dst);
+                    }
+                    compile(*expr.children.back(), dst);
+                    break;
+                case native::LET:
+                    compile_bindings(expr);
+                    compile(*expr.children.back(), dst);
+                    break;
+                case native::LAMBDA:
+                    emit(CLOSURE, dst, compile_lambda(*expr.lambda));
+                    break;
+                case native::DEF:
+                    compile(*expr.children[0], dst);
+                    emit(DEF, index_of(proto.globals, expr.global), dst);
+                    break;
+                case native::VECTOR:
+                case native::MAP:
+                case native::SET:
+                    {
+                        Op op = expr.kind == native::VECTOR ? VECTOR : expr.kind == native::MAP ? MAP : SET;
+                        auto first = compile_all(expr.children, 0);
+                        emit(op, dst, first, expr.children.size());
+                    }
+                    break;
+                case native::CALL:
+                    if (auto op = operator_of(expr)) {
+                        auto global = expr.children[0]->global;
+                        auto first = compile_all(expr.children, 1);
+                        auto index = proto.operators.size();
+                        proto.operators.push_back(Operator{global, *global->value});
+                        emit(*op, dst, first, index);
+                    } else {
+                        auto fn = compile_all(expr.children, 0);
+                        emit(CALL, dst, fn, expr.children.size() - 1);
+                    }
+                    break;
+            }
+            next = saved;
+        }
+
+        // compiles expr as the last thing a function does
+        void compile_tail(const Expr & expr) {
+            auto saved = next;
+            switch (expr.kind) {
+                case native::IF:
+                    {
+                        auto test = operand(*expr.children[0]);
+                        auto jump_else = emit(JUMP_IF_NOT, test);
+                        next = saved;
+                        compile_tail(*expr.children[1]);
+                        proto.code[jump_else].b = here();
+                        if (expr.children.size() == 3) {
+                            compile_tail(*expr.children[2]);
+                        } else {
+                            auto reg = allocate();
+                            emit(CONST, reg, constant(native::nil()));
+                            emit(RETURN, reg);
+                        }
+                    }
+                    break;
+                case native::DO:
+                    {
+                        auto reg = allocate();
+                        for (std::size_t i = 0; i + 1 < expr.children.size(); ++i) {
+                            compile(*expr.children[i], reg);
+                        }
+                        next = saved;
+                        compile_tail(*expr.children.back());
+                    }
+                    break;
+                case native::LET:
+                    compile_bindings(expr);
+                    compile_tail(*expr.children.back());
+                    break;
+                case native::CALL:
+                    if (!operator_of(expr)) {
+                        auto fn = compile_all(expr.children, 0);
+                        emit(TAIL_CALL, fn, expr.children.size() - 1);
+                        break;
+                    }
+                    [[fallthrough]];
+                default:
+                    emit(RETURN, operand(expr));
+            }
+            next = saved;
+        }
+
+        void compile_bindings(const Expr & expr) {
+            for (auto & slot : expr.slots) {
+                if (slot.cell) {
+                    emit(CELL, slot.index);
+                }
+            }
+            for (std::size_t i = 0; i < expr.slots.size(); ++i) {
+                auto & slot = expr.slots[i];
+                if (slot.cell) {
+                    auto saved = next;
+                    auto reg = allocate();
+                    compile(*expr.children[i], reg);
+                    emit(STORE_CELL, slot.index, reg);
+                    next = saved;
+                } else {
+                    compile(*expr.children[i], slot.index);
+                }
+            }
+        }
+
+        std::uint32_t compile_lambda(const native::Lambda & lambda) {
+            proto.protos.push_back(compile(*lambda.body, lambda.params, lambda.variadic, lambda.frame_size, lambda.captures, lambda.self));
+            return proto.protos.size() - 1;
+        }
+    };
+
+    struct Frame {
+        const Proto *proto;
+        const Instruction *ip;
+        std::size_t base;
+        std::uint32_t dst;
+        const native::Env *env;
+    };
+
+    // puts the arguments of a call, which are in the first count registers
+    // from base, where the function expects them. the function itself is
+    // in the register before them
+    void enter(const Bytecode & fn, std::vector<form::Form> & registers, std::size_t base, std::size_t count) {
+        auto & proto = *fn.proto;
+        if (count < proto.params || (!proto.variadic && count > proto.params)) {
+            throw native::error("Wrong number of arguments: expected " + std::to_string(proto.params) + ", got " + std::to_string(count));
+        }
+        if (registers.size() < base + proto.registers) {
+            registers.resize(base + proto.registers, native::nil());
+        }
+        auto regs = registers.data() + base;
+        if (proto.variadic) {
+            form::List::Builder rest;
+            for (auto i = proto.params; i < count; ++i) {
+                rest.push_back(form::FormWrapper{std::move(regs[i])});
+            }
+            regs[proto.params] = rest.persistent();
+        }
+        // locals shouldn't see what was in their registers before
+        std::fill(regs + proto.params + proto.variadic, regs + proto.frame_size, native::nil());
+        if (proto.self) {
+            regs[*proto.self] = regs[-1];
+        }
+    }
+
+    template <class Op>
+    bool compare(const form::Form & a, const form::Form & b, Op op) {
+        return op(a.token_long(), b.token_long());
+    }
+
+    // runs fn on the count registers from base, which it takes as its own
+    form::Form run(const Bytecode & fn, std::size_t base, std::size_t count, native::Runtime & runtime) {
+        auto & registers = runtime.registers;
+        auto start = base - 1;
+        std::vector<Frame> frames;
+
+        enter(fn, registers, base, count);
+        const Proto *proto = fn.proto.get();
+        const native::Env *env = fn.env.get();
+        const Instruction *ip = proto->code.data();
+        form::Form *regs = registers.data() + base;
+
+        // calls fn, whose arguments are the count registers after it, and
+        // says whether it was bytecode that is now being run. the function
+        // itself is kept just before its registers, so it lives as long
+        // as the call does
+        auto call = [&](std::uint32_t fn_reg, std::uint32_t count, bool tail, std::uint32_t dst) -> bool {
+            auto & callee = regs[fn_reg];
+            if (callee.index() != form::FN) {
+                throw native::error(pr_str(callee) + " is not a function");
+            }
+            auto & function = native::function(callee);
+            if (function.kind != native::Function::BYTECODE) {
+                auto ret = function.call(callee, regs + fn_reg + 1, count, runtime);
+                regs = registers.data() + base;
+                if (tail) {
+                    regs[fn_reg] = std::move(ret);
+                    return false;
+                }
+                regs[dst] = std::move(ret);
+                return false;
+            }
+            if (tail) {
+                // the caller is done with its registers, so the callee takes them over
+                regs[-1] = std::move(callee);
+                std::move(regs + fn_reg + 1, regs + fn_reg + 1 + count, regs);
+            } else {
+                frames.push_back(Frame{proto, ip, base, dst, env});
+                base += fn_reg + 1;
+            }
+            auto & called = static_cast<const Bytecode &>(native::function(registers[base - 1]));
+            enter(called, registers, base, count);
+            proto = called.proto.get();
+            env = called.env.get();
+            ip = proto->code.data();
+            regs = registers.data() + base;
+            return true;
+        };
+
+        // returns from the current call, and says whether it was the last one
+        auto return_from = [&](form::Form ret) -> bool {
+            if (frames.empty()) {
+                regs[-1] = std::move(ret);
+                return true;
+            }
+            auto & frame = frames.back();
+            proto = frame.proto;
+            ip = frame.ip;
+            base = frame.base;
+            env = frame.env;
+            regs = registers.data() + base;
+            regs[frame.dst] = std::move(ret);
+            frames.pop_back();
+            return false;
+        };
+
+        auto arithmetic = [&](const Instruction & in, auto fast) {
+            auto & a = regs[in.b];
+            auto & b = regs[in.b + 1];
+            auto & op = proto->operators[in.c];
+            if (a.index() == form::TOKEN && b.index() == form::TOKEN && a.value_type() == token::value::LONG && b.value_type() == token::value::LONG
+                && op.global->value && op.global->value->object() == op.builtin.object()) {
+                regs[in.a] = fast(a, b);
+                return;
+            }
+            auto value = op.global->value ? *op.global->value : runtime.lookup_host(*op.global);
+            if (value.index() != form::FN) {
+                throw native::error(pr_str(value) + " is not a function");
+            }
+            auto ret = native::function(value).call(value, regs + in.b, 2, runtime);
+            regs = registers.data() + base;
+            regs[in.a] = std::move(ret);
+        };
+
+        auto number = [](long l) {
+            return form::Form(token::Token{l, token::type::NUMBER, 0, 0});
+        };
+
+        auto boolean = [](bool b) {
+            return form::Form(token::Token{b, token::type::SYMBOL, 0, 0});
+        };
+
+#ifdef ZACHLISP_COMPUTED_GOTO
+        // jumps straight to the code for each instruction from the end of the
+        // last one, rather than going back to the switch
+        static void * const LABELS[] = {
+            &&op_CONST, &&op_MOVE, &&op_CAPTURED, &&op_CELL, &&op_LOAD_CELL, &&op_STORE_CELL, &&op_GLOBAL, &&op_DEF, &&op_JUMP,
+            &&op_JUMP_IF_NOT, &&op_CALL, &&op_TAIL_CALL, &&op_RETURN, &&op_CLOSURE, &&op_VECTOR,
+            &&op_MAP, &&op_SET, &&op_ADD, &&op_SUB, &&op_MUL, &&op_LT, &&op_LE, &&op_GT, &&op_GE, &&op_EQ
+        };
+#define TARGET(op) case op: op_##op:
+#define DISPATCH() goto *LABELS[ip->op]
+#else
+#define TARGET(op) case op:
+#define DISPATCH() continue
+#endif
+#define NEXT() ++ip; DISPATCH()
+
+        for (;;) {
+            switch (ip->op) {
+                TARGET(CONST)
+                    regs[ip->a] = proto->constants[ip->b];
+                    NEXT();
+                TARGET(MOVE)
+                    regs[ip->a] = regs[ip->b];
+                    NEXT();
+                TARGET(CAPTURED)
+                    regs[ip->a] = env->slots[ip->b];
+                    NEXT();
+                TARGET(CELL)
+                    regs[ip->a] = runtime.make_cell();
+                    NEXT();
+                TARGET(LOAD_CELL)
+                    regs[ip->a] = native::cell(regs[ip->b]).value;
+                    NEXT();
+                TARGET(STORE_CELL)
+                    native::cell(regs[ip->a]).value = std::move(regs[ip->b]);
+                    NEXT();
+                TARGET(GLOBAL)
+                    {
+                        auto global = proto->globals[ip->b];
+                        if (global->value) {
+                            regs[ip->a] = *global->value;
+                        } else {
+                            auto value = runtime.lookup_host(*global);
+                            regs = registers.data() + base;
+                            regs[ip->a] = std::move(value);
+                        }
+                    }
+                    NEXT();
+                TARGET(DEF)
+                    proto->globals[ip->a]->value = regs[ip->b];
+                    NEXT();
+                TARGET(JUMP)
+                    ip = proto->code.data() + ip->a;
+                    DISPATCH();
+                TARGET(JUMP_IF_NOT)
+                    if (!native::is_truthy(regs[ip->a])) {
+                        ip = proto->code.data() + ip->b;
+                        DISPATCH();
+                    }
+                    NEXT();
+                TARGET(CALL)
+                    if (call(ip->b, ip->c, false, ip->a)) {
+                        DISPATCH();
+                    }
+                    NEXT();
+                TARGET(TAIL_CALL)
+                    if (call(ip->a, ip->b, true, 0)) {
+                        DISPATCH();
+                    }
+                    // the callee wasn't bytecode, and has already returned
+                    if (return_from(std::move(regs[ip->a]))) {
+                        goto done;
+                    }
+                    NEXT();
+                TARGET(RETURN)
+                    if (return_from(std::move(regs[ip->a]))) {
+                        goto done;
+                    }
+                    NEXT();
+                TARGET(CLOSURE)
+                    {
+                        auto & child = proto->protos[ip->b];
+                        EnvPtr captured;
+                        if (!child->captures.empty()) {
+                            captured = std::make_shared<native::Env>();
+                            captured->slots.reserve(child->captures.size());
+                            for (auto & slot : child->captures) {
+                                captured->slots.push_back(slot.depth ? env->slots[slot.index] : regs[slot.index]);
+                            }
+                        }
+                        regs[ip->a] = form::Fn(std::make_unique<Bytecode>(child, std::move(captured)));
+                    }
+                    NEXT();
+                TARGET(VECTOR)
+                    {
+                        auto vec = form::Vector().transient();
+                        for (std::uint32_t i = 0; i < ip->c; ++i) {
+                            vec.push_back(form::FormWrapper{regs[ip->b + i]});
+                        }
+                        regs[ip->a] = vec.persistent();
+                    }
+                    NEXT();
+                TARGET(MAP)
+                    {
+                        auto map = form::FormWrapperMap().transient();
+                        for (std::uint32_t i = 0; i + 1 < ip->c; i += 2) {
+                            map.insert(form::FormWrapper{regs[ip->b + i]}, form::FormWrapper{regs[ip->b + i + 1]});
+                        }
+                        regs[ip->a] = map.persistent();
+                    }
+                    NEXT();
+                TARGET(SET)
+                    {
+                        auto set = form::FormWrapperSet().transient();
+                        for (std::uint32_t i = 0; i < ip->c; ++i) {
+                            set.insert(form::FormWrapper{regs[ip->b + i]});
+                        }
+                        regs[ip->a] = set.persistent();
+                    }
+                    NEXT();
+                TARGET(ADD)
+                    arithmetic(*ip, [&](auto & a, auto & b) { return number(a.token_long() + b.token_long()); });
+                    NEXT();
+                TARGET(SUB)
+                    arithmetic(*ip, [&](auto & a, auto & b) { return number(a.token_long() - b.token_long()); });
+                    NEXT();
+                TARGET(MUL)
+                    arithmetic(*ip, [&](auto & a, auto & b) { return number(a.token_long() * b.token_long()); });
+                    NEXT();
+                TARGET(LT)
+                    arithmetic(*ip, [&](auto & a, auto & b) { return boolean(compare(a, b, std::less<>())); });
+                    NEXT();
+                TARGET(LE)
+                    arithmetic(*ip, [&](auto & a, auto & b) { return boolean(compare(a, b, std::less_equal<>())); });
+                    NEXT();
+                TARGET(GT)
+                    arithmetic(*ip, [&](auto & a, auto & b) { return boolean(compare(a, b, std::greater<>())); });
+                    NEXT();
+                TARGET(GE)
+                    arithmetic(*ip, [&](auto & a, auto & b) { return boolean(compare(a, b, std::greater_equal<>())); });
+                    NEXT();
+                TARGET(EQ)
+                    arithmetic(*ip, [&](auto & a, auto & b) { return boolean(compare(a, b, std::equal_to<>())); });
+                    NEXT();
+            }
+        }
+
+#undef NEXT
+#undef DISPATCH
+#undef TARGET
+
+    done:
+        auto ret = std::move(registers[start]);
+        registers.erase(registers.begin() + start, registers.end());
+        return ret;
+    }
+
+    form::Form Bytecode::call(const form::Form & self, form::Form *args, std::size_t count, native::Runtime & runtime) const {
+        // the function and arguments might be in the registers, which are about to grow
+        form::Form callee = self;
+        std::vector<form::Form> moved(std::make_move_iterator(args), std::make_move_iterator(args + count));
+        auto & registers = runtime.registers;
+        auto base = registers.size() + 1;
+        registers.push_back(std::move(callee));
+        std::move(moved.begin(), moved.end(), std::back_inserter(registers));
+        return run(*this, base, count, runtime);
+    }
+
+    form::Form eval(const form::Form & form, native::Runtime & runtime) {
+        native::Analyzer analyzer(runtime);
+        auto expr = analyzer.analyze(form);
+        Bytecode fn(Compiler::compile(*expr, 0, false, analyzer.frame_size()), nullptr);
+        auto & registers = runtime.registers;
+        auto base = registers.size() + 1;
+        registers.push_back(native::nil());
+        return run(fn, base, 0, runtime);
+    }
+
+    }
+
+enum class Evaluator {TREE_WALKER, BYTECODE};
+
+std::list<form::Form> eval(const std::list<form::Form> & forms, native::Runtime & runtime, Evaluator evaluator) {
+    if (evaluator == Evaluator::TREE_WALKER) {
+        return eval(forms, runtime);
+    }
+    return eval_each(forms, runtime, [&](const form::Form & form) {
+        return vm::eval(form, runtime);
+    });
+}
+
+}